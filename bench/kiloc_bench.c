@@ -0,0 +1,395 @@
+/**
+ * @file kiloc_bench.c
+ * @brief Microbenchmarks for the kiloc rendering hot paths.
+ *
+ * Includes kiloc.c directly so that static functions such as _kiloc_apply_style,
+ * _kiloc_encode and _kiloc_cmp_box_render can be timed on their own. Everything
+ * runs on the headless backend: no terminal is needed, and the bytes reported
+ * are exactly what a terminal would have been sent.
+ *
+ * Build and run from the repository root:
+ *
+ *     cc -O2 -pthread -o kiloc_bench bench/kiloc_bench.c && ./kiloc_bench [filter]
+ *
+ * Only benchmarks whose name contains filter are run. Each one is repeated
+ * until KILOC_BENCH_MS have passed and reports ns/op and bytes emitted per op.
+ */
+#include "../kiloc.c"
+
+/* Minimum wall time spent in each benchmark. */
+#define KILOC_BENCH_MS 200
+
+/* Canvas sizes benchmarked. */
+static const uint16_t _bench_sizes[][2] = { { 80, 24 }, { 200, 60 }, { 400, 120 } };
+
+/* Share of the cells changed per frame, in percent. */
+static const int _bench_density[] = { 0, 1, 10, 100 };
+
+/* A few styles for changed cells, so SGR changes are part of the work. */
+static uint64_t _bench_styles[4];
+
+static const char *_bench_filter;
+static uint32_t _bench_seed = 0x2545f491;
+
+/**
+ * @brief Returns a pseudo-random number (xorshift32, reproducible between runs).
+ */
+static uint32_t _bench_rand(void)
+{
+        _bench_seed ^= _bench_seed << 13;
+        _bench_seed ^= _bench_seed >> 17;
+        _bench_seed ^= _bench_seed << 5;
+        return _bench_seed;
+}
+
+/**
+ * @brief Returns whether a benchmark was selected on the command line.
+ */
+static bool _bench_want(const char *name)
+{
+        return _bench_filter == NULL || strstr(name, _bench_filter) != NULL;
+}
+
+/**
+ * @brief Returns the bytes written to the headless terminal and discards them.
+ */
+static size_t _bench_drain(void)
+{
+        size_t len;
+
+        _kiloc_flush();
+        kiloc_headless_output(&len);
+        kiloc_headless_clear();
+        return len;
+}
+
+/**
+ * @brief Prints one result line.
+ * @param name Benchmark name.
+ * @param w Canvas width (0 if not applicable).
+ * @param h Canvas height.
+ * @param density Changed cells in percent (-1 if not applicable).
+ * @param ns Total time in nanoseconds.
+ * @param bytes Total bytes emitted.
+ * @param ops Number of operations timed.
+ */
+static void _bench_report(const char *name, uint16_t w, uint16_t h, int density,
+                          uint64_t ns, size_t bytes, uint64_t ops)
+{
+        char size[16] = "-", dens[16] = "-";
+
+        if (w) snprintf(size, sizeof(size), "%ux%u", w, h);
+        if (density >= 0) snprintf(dens, sizeof(dens), "%d%%", density);
+        printf("%-24s %9s %5s %12.1f %12.1f\n", name, size, dens,
+               (double)ns / (double)ops, (double)bytes / (double)ops);
+}
+
+/**
+ * @brief Sets up a Win mode canvas of w x h cells on a terminal of the same size.
+ */
+static void _bench_init(uint16_t w, uint16_t h, uint16_t num_comp)
+{
+        struct kiloc_caps caps = { .truecolor = true };
+
+        kiloc_headless(w, h);
+        kiloc_init(w, h, w, h, Win, false, num_comp);
+        kiloc_set_caps(&caps);
+        kiloc_render();
+        _bench_drain();
+}
+
+/**
+ * @brief Tears the canvas down and drops the teardown output.
+ */
+static void _bench_fini(void)
+{
+        kiloc_shutdown();
+        kiloc_headless_clear();
+}
+
+/**
+ * @brief Changes density percent of the back buffer's cells (content and style).
+ */
+static void _bench_mutate(int density)
+{
+        uint32_t n = (uint32_t)k->max_w * k->max_h * (uint32_t)density / 100;
+
+        for (uint32_t i = 0; i < n; ++i) {
+                uint32_t r = _bench_rand();
+                struct kiloc_cell *c = &k->b_buffer[r % k->max_h][(r >> 8) % k->max_w];
+
+                c->content[0] = c->content[0] == 'a' ? 'b' : 'a';
+                c->content[1] = '\0';
+                c->style = _bench_styles[(r >> 24) & 3];
+        }
+}
+
+/**
+ * @brief kiloc_putchr over the whole canvas; one op is one cell.
+ */
+static void _bench_putchr(uint16_t w, uint16_t h)
+{
+        uint64_t ops = 0, start, ns;
+
+        _bench_init(w, h, 1);
+        start = _kiloc_now_ns();
+        do {
+                for (uint16_t y = 0; y < h; ++y)
+                        for (uint16_t x = 0; x < w; ++x)
+                                kiloc_putchr(x, y, "x", _bench_styles[x & 3]);
+                ops += (uint64_t)w * h;
+                ns = _kiloc_now_ns() - start;
+        } while (ns < KILOC_BENCH_MS * 1000000ull);
+        _bench_report("putchr", w, h, -1, ns, 0, ops);
+        _bench_fini();
+}
+
+/**
+ * @brief kiloc_putstr of one line per row; one op is one call.
+ */
+static void _bench_putstr(const char *name, const char *unit, uint16_t w, uint16_t h)
+{
+        size_t ul = strlen(unit), len = 0;
+        char *line = malloc((size_t)w * ul + 1);
+        uint64_t ops = 0, start, ns;
+
+        // Enough of the unit to fill a row, even if it is one column wide.
+        for (uint16_t i = 0; i < w; ++i, len += ul)
+                memcpy(line + len, unit, ul);
+        line[len] = '\0';
+
+        _bench_init(w, h, 1);
+        start = _kiloc_now_ns();
+        do {
+                for (uint16_t y = 0; y < h; ++y)
+                        kiloc_putstr(0, y, line, _bench_styles[y & 3]);
+                ops += h;
+                ns = _kiloc_now_ns() - start;
+        } while (ns < KILOC_BENCH_MS * 1000000ull);
+        _bench_report(name, w, h, -1, ns, 0, ops);
+        _bench_fini();
+        free(line);
+}
+
+/**
+ * @brief _kiloc_apply_style over changing styles; one op is one SGR sequence.
+ */
+static void _bench_apply_style(const char *name, bool truecolor)
+{
+        struct kiloc_buf b = { .fd = -1 };
+        uint64_t styles[256], ops = 0, start, ns;
+        size_t bytes = 0;
+
+        for (int i = 0; i < 256; ++i) {
+                uint32_t r = _bench_rand();
+                styles[i] = kiloc_make_style(r & 0xffffff, _bench_rand() & 0xffffff,
+                                             r >> 31, (r >> 30) & 1, (r >> 29) & 1);
+        }
+
+        start = _kiloc_now_ns();
+        do {
+                for (int i = 0; i < 256; ++i)
+                        _kiloc_apply_style(&b, styles[i], truecolor);
+                bytes += b.len;
+                b.len = 0;
+                ops += 256;
+                ns = _kiloc_now_ns() - start;
+        } while (ns < KILOC_BENCH_MS * 1000000ull);
+        _bench_report(name, 0, 0, -1, ns, bytes, ops);
+}
+
+/**
+ * @brief The frame diff alone: _kiloc_encode of the back buffer against the
+ *        front buffer after density percent of the cells changed. One op is one frame.
+ */
+static void _bench_encode(uint16_t w, uint16_t h, int density)
+{
+        struct kiloc_enc e = {
+                .b = &_kiloc_out, .caps = &k->caps, .rows = h, .cols = w, .ter_w = w,
+        };
+        uint64_t ops = 0, ns = 0, t;
+        size_t bytes = 0;
+
+        _bench_init(w, h, 1);
+        do {
+                _bench_mutate(density);
+                t = _kiloc_now_ns();
+                _kiloc_encode(&e, k->f_buffer, k->b_buffer, true);
+                _kiloc_flush();
+                ns += _kiloc_now_ns() - t;
+                bytes += _bench_drain();
+                ++ops;
+        } while (ns < KILOC_BENCH_MS * 1000000ull);
+        _bench_report("encode", w, h, density, ns, bytes, ops);
+        _bench_fini();
+}
+
+/**
+ * @brief A whole kiloc_render of one text component per row, with density
+ *        percent of the characters changed between frames. One op is one frame.
+ */
+static void _bench_render(uint16_t w, uint16_t h, int density)
+{
+        struct kiloc_cmp *cmps = calloc(h, sizeof(*cmps));
+        char **rows = calloc(h, sizeof(*rows));
+        uint64_t ops = 0, ns = 0, t;
+        size_t bytes = 0;
+
+        _bench_init(w, h, h + 1);
+        for (uint16_t y = 0; y < h; ++y) {
+                rows[y] = malloc((size_t)w + 1);
+                memset(rows[y], 'a', w);
+                rows[y][w] = '\0';
+                cmps[y] = (struct kiloc_cmp){ .cid = y + 1, .type = text };
+                struct text *tx = kiloc_addcmp(&cmps[y]);
+                tx->x = 0;
+                tx->y = y;
+                tx->content = rows[y];
+                tx->style = _bench_styles[y & 3];
+        }
+        kiloc_render();
+        _bench_drain();
+
+        do {
+                uint32_t n = (uint32_t)w * h * (uint32_t)density / 100;
+                for (uint32_t i = 0; i < n; ++i) {
+                        uint32_t r = _bench_rand();
+                        char *c = &rows[r % h][(r >> 8) % w];
+                        *c = *c == 'a' ? 'b' : 'a';
+                }
+                t = _kiloc_now_ns();
+                kiloc_render();
+                ns += _kiloc_now_ns() - t;
+                bytes += _bench_drain();
+                ++ops;
+        } while (ns < KILOC_BENCH_MS * 1000000ull);
+        _bench_report("render", w, h, density, ns, bytes, ops);
+        _bench_fini();
+
+        for (uint16_t y = 0; y < h; ++y)
+                free(rows[y]);
+        free(rows);
+        free(cmps);
+}
+
+/**
+ * @brief A frame of a canvas tiled with bindings (one per 8 columns), density
+ *        percent of which change. One op is one kiloc_render, either a full
+ *        frame or a live frame as the continuous event loop renders it.
+ */
+static void _bench_bindings(uint16_t w, uint16_t h, int density, bool live)
+{
+        uint32_t n = (uint32_t)(w / 8) * h;
+        struct kiloc_cmp *cmps = calloc(n, sizeof(*cmps));
+        uint32_t *vals = calloc(n, sizeof(*vals));
+        uint64_t ops = 0, ns = 0, t;
+        size_t bytes = 0;
+
+        _bench_init(w, h, (uint16_t)(n + 1));
+        for (uint32_t i = 0; i < n; ++i) {
+                cmps[i] = (struct kiloc_cmp){ .cid = (uint16_t)(i + 1), .type = binding };
+                struct binding *b = kiloc_addcmp(&cmps[i]);
+                b->x = (uint16_t)(i % (w / 8) * 8);
+                b->y = (uint16_t)(i / (w / 8));
+                b->ptr = &vals[i];
+                b->vtype = KILOC_BIND_U32;
+                b->fmt = NULL;
+                b->atomic = false;
+                b->style = _bench_styles[i & 3];
+                b->valid = false;
+        }
+        kiloc_render();
+        _bench_drain();
+
+        do {
+                uint32_t changed = n * (uint32_t)density / 100;
+                for (uint32_t i = 0; i < changed; ++i)
+                        vals[_bench_rand() % n] += 1;
+                t = _kiloc_now_ns();
+                k->live = live;
+                kiloc_render();
+                k->live = false;
+                ns += _kiloc_now_ns() - t;
+                bytes += _bench_drain();
+                ++ops;
+        } while (ns < KILOC_BENCH_MS * 1000000ull);
+        _bench_report(live ? "bind_live" : "bind_full", w, h, density, ns, bytes, ops);
+        _bench_fini();
+
+        free(vals);
+        free(cmps);
+}
+
+/**
+ * @brief _kiloc_cmp_box_render of a box covering the canvas, with a title.
+ *        One op is one box.
+ */
+static void _bench_box(uint16_t w, uint16_t h)
+{
+        struct kiloc_cmp c = { .cid = 1, .type = box };
+        uint64_t ops = 0, start, ns;
+
+        _bench_init(w, h, 2);
+        struct box *bx = kiloc_addcmp(&c);
+        bx->x = bx->y = 0;
+        bx->w = w;
+        bx->h = h;
+        bx->title = "kiloc benchmark";
+        bx->border_style = _bench_styles[1];
+        bx->focus_style = 0;
+
+        start = _kiloc_now_ns();
+        do {
+                _kiloc_cmp_box_render(&c);
+                ++ops;
+                ns = _kiloc_now_ns() - start;
+        } while (ns < KILOC_BENCH_MS * 1000000ull);
+        _bench_report("box_render", w, h, -1, ns, 0, ops);
+        _bench_fini();
+}
+
+int main(int argc, char **argv)
+{
+        static const struct { const char *name, *unit; } strs[] = {
+                { "putstr_ascii", "x" }, { "putstr_cjk", "\xe6\xbc\xa2" }, { "putstr_emoji", "\xf0\x9f\x98\x80" },
+        };
+        const size_t n_sizes = sizeof(_bench_sizes) / sizeof(_bench_sizes[0]);
+        const size_t n_dens = sizeof(_bench_density) / sizeof(_bench_density[0]);
+
+        if (argc > 1) _bench_filter = argv[1];
+
+        _bench_styles[0] = 0;
+        _bench_styles[1] = kiloc_make_style(0xff8800, 0x000000, true, false, false);
+        _bench_styles[2] = kiloc_make_style(0x00ccff, 0x202020, false, true, false);
+        _bench_styles[3] = kiloc_make_style(0xffffff, 0x5050a0, false, false, true);
+
+        printf("%-24s %9s %5s %12s %12s\n", "benchmark", "canvas", "chg", "ns/op", "bytes/op");
+
+        for (size_t s = 0; s < n_sizes; ++s) {
+                uint16_t w = _bench_sizes[s][0], h = _bench_sizes[s][1];
+
+                if (_bench_want("putchr"))
+                        _bench_putchr(w, h);
+                for (size_t i = 0; i < sizeof(strs) / sizeof(strs[0]); ++i)
+                        if (_bench_want(strs[i].name))
+                                _bench_putstr(strs[i].name, strs[i].unit, w, h);
+                if (_bench_want("box_render"))
+                        _bench_box(w, h);
+                for (size_t d = 0; d < n_dens; ++d) {
+                        if (_bench_want("encode"))
+                                _bench_encode(w, h, _bench_density[d]);
+                        if (_bench_want("render"))
+                                _bench_render(w, h, _bench_density[d]);
+                        if (_bench_want("bind_full"))
+                                _bench_bindings(w, h, _bench_density[d], false);
+                        if (_bench_want("bind_live"))
+                                _bench_bindings(w, h, _bench_density[d], true);
+                }
+        }
+        if (_bench_want("apply_style_truecolor"))
+                _bench_apply_style("apply_style_truecolor", true);
+        if (_bench_want("apply_style_256"))
+                _bench_apply_style("apply_style_256", false);
+
+        return 0;
+}
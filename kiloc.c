@@ -5,6 +5,7 @@
  * Contains buffer management, terminal I/O functions, component tree rendering logic,
  * and the main rendering loop.
  */
+#define _GNU_SOURCE
 #include "kiloc.h"
 
 /*-------- Global --------*/
@@ -14,27 +15,309 @@ static struct kiloc *k = &kiloc_config; /* Convenience pointer to the global sta
 /*-------- Base APIs --------*/
 /* Static */
 
+/* Set by SIGWINCH (handler or signalfd); the size is only re-queried after it. */
+static volatile sig_atomic_t _kiloc_winch = 1;
+
+struct kiloc_buf;
+
+static void _kiloc_emit(const struct kiloc_event *ev);
+static void _kiloc_rec_resize(uint16_t w, uint16_t h);
+static bool _kiloc_input_pending(void);
+static void _kiloc_coalesce_flush(void);
+static bool _kiloc_coalesce_add(const struct kiloc_event *ev);
+static bool _kiloc_focus_route(const struct kiloc_event *ev);
+static bool _kiloc_keys_dispatch(const struct kiloc_event *ev);
+static void _kiloc_rec_input(const char *buf, size_t len);
+static void _kiloc_rec_flush(void);
+static void _kiloc_rec_frame(void);
+static void _kiloc_replay_step(void);
+static uint64_t _kiloc_now_ns(void);
+static void _kiloc_loop_unblock(void);
+static void _kiloc_lat_overlay(void);
+static void _kiloc_lat_frame(void);
+static uint64_t _kiloc_ft_lap(uint64_t *lap);
+static void _kiloc_ft_overlay(void);
+static void _kiloc_ft_frame(const uint64_t *ph, uint64_t start, uint64_t bytes, uint32_t cells);
+static void _kiloc_prof_begin(void);
+static void _kiloc_prof_cmp(struct kiloc_cmp *c);
+static void _kiloc_prof_cell(uint16_t x, uint16_t y);
+static void _kiloc_prof_overlay(void);
+static void _kiloc_caps_hints(void);
+static void _kiloc_caps_probe(void);
+static void _kiloc_caps_arm(void);
+static void _kiloc_caps_poll(void);
+static void _kiloc_caps_csi(uint8_t final);
+static void _kiloc_caps_dcs(void);
+static uint16_t _kiloc_inline_cpr(void);
+static void _kiloc_inline_reserve(void);
+static void _kiloc_inline_clear(void);
+static void _kiloc_inline_move(struct kiloc_buf *b, uint16_t *row, uint16_t x, uint16_t y);
+static void _kiloc_clear_rows(uint16_t from, uint16_t to);
+static uint16_t _kiloc_str_width(const char *str);
+static void _kiloc_rs_frame(void);
+static bool _kiloc_rc_route(const struct kiloc_event *ev);
+static void _kiloc_remote_close(void);
+static void _kiloc_sinks_frame(uint16_t rows, uint16_t cols, const uint8_t *dirty);
+static void _kiloc_sinks_close(void);
+static void _kiloc_cast_put(char type, const char *data, size_t len);
+static void _kiloc_cast_frame(uint16_t rows, uint16_t cols);
+
+/* Bytes staged before each write to the output backend. */
+#define KILOC_BUF 65536
+
+/* Output staging buffer, drained into a backend or straight to an fd. */
+struct kiloc_buf {
+        const struct kiloc_backend *be; // Destination, or NULL to write to fd.
+        int fd;
+        bool err;                       // A write failed.
+        uint64_t sent;                  // Bytes written out so far.
+        size_t len;
+        char data[KILOC_BUF];
+};
+
+/* Staging buffer of everything sent to the terminal (or the backend standing in for it). */
+static struct kiloc_buf _kiloc_out = { .fd = STDOUT_FILENO };
+
 /**
- * @brief Checks for terminal window size changes.
+ * @brief Writes all bytes to an fd, retrying short and interrupted writes.
+ * @param fd The fd.
+ * @param buf The bytes.
+ * @param len Number of bytes.
+ * @return 0 on success, -1 on error.
+ */
+static int _kiloc_write_all(int fd, const char *buf, size_t len)
+{
+        while (len > 0) {
+                ssize_t r = write(fd, buf, len);
+                if (r == -1) {
+                        if (errno == EINTR) continue;
+                        return -1;
+                }
+                buf += r;
+                len -= (size_t)r;
+        }
+        return 0;
+}
+
+/**
+ * @brief Writes out everything staged in an output buffer.
+ * @param b The buffer.
+ */
+static void _kiloc_buf_flush(struct kiloc_buf *b)
+{
+        if (b->len == 0) return;
+
+        // Terminal output is also recorded while an asciicast is running.
+        if (b == &_kiloc_out && k->cast)
+                _kiloc_cast_put('o', b->data, b->len);
+
+        if (b->be ? b->be->write(b->be->ud, b->data, b->len) == -1
+                  : _kiloc_write_all(b->fd, b->data, b->len) == -1)
+                b->err = true;
+        b->sent += b->len;
+        b->len = 0;
+}
+
+/**
+ * @brief Appends bytes to an output buffer, writing it out when full.
+ * @param b The buffer.
+ * @param s The bytes.
+ * @param n Number of bytes.
+ */
+static void _kiloc_buf_put(struct kiloc_buf *b, const char *s, size_t n)
+{
+        if (b->len + n > sizeof(b->data))
+                _kiloc_buf_flush(b);
+
+        // Larger than the whole buffer: pass it through in buffer-sized pieces.
+        while (n > sizeof(b->data)) {
+                memcpy(b->data, s, sizeof(b->data));
+                b->len = sizeof(b->data);
+                _kiloc_buf_flush(b);
+                s += sizeof(b->data);
+                n -= sizeof(b->data);
+        }
+        memcpy(b->data + b->len, s, n);
+        b->len += n;
+}
+
+/**
+ * @brief Stages a string for the terminal.
+ * @param s The string.
+ */
+static void _kiloc_puts(const char *s)
+{
+        _kiloc_buf_put(&_kiloc_out, s, strlen(s));
+}
+
+/**
+ * @brief Stages formatted output in an output buffer.
  *
- * Uses ioctl(TIOCGWINSZ) to query the current terminal dimensions.
+ * Meant for escape sequences and short messages; output longer than the
+ * buffer is truncated.
  *
- * @return True if the terminal size has changed, false otherwise.
+ * @param b The buffer.
+ * @param fmt printf-style format.
+ * @param ap The arguments.
  */
-static bool _kiloc_check_tersize(void)
+static void _kiloc_buf_vprintf(struct kiloc_buf *b, const char *fmt, va_list ap)
+{
+        size_t room = sizeof(b->data) - b->len;
+        va_list again;
+        int n;
+
+        va_copy(again, ap);
+        n = vsnprintf(b->data + b->len, room, fmt, ap);
+        if (n >= 0 && (size_t)n >= room) {
+                // Did not fit: make room and format again.
+                _kiloc_buf_flush(b);
+                room = sizeof(b->data);
+                n = vsnprintf(b->data, room, fmt, again);
+                if ((size_t)n >= room) n = (int)room - 1;
+        }
+        va_end(again);
+        if (n > 0) b->len += (size_t)n;
+}
+
+/**
+ * @brief Stages formatted output in an output buffer (see _kiloc_buf_vprintf).
+ */
+static void _kiloc_buf_printf(struct kiloc_buf *b, const char *fmt, ...)
+{
+        va_list ap;
+
+        va_start(ap, fmt);
+        _kiloc_buf_vprintf(b, fmt, ap);
+        va_end(ap);
+}
+
+/**
+ * @brief Stages formatted output for the terminal (see _kiloc_buf_vprintf).
+ */
+static void _kiloc_printf(const char *fmt, ...)
+{
+        va_list ap;
+
+        va_start(ap, fmt);
+        _kiloc_buf_vprintf(&_kiloc_out, fmt, ap);
+        va_end(ap);
+}
+
+/**
+ * @brief Sends everything staged for the terminal to the backend.
+ */
+static void _kiloc_flush(void)
+{
+        _kiloc_buf_flush(&_kiloc_out);
+}
+
+/**
+ * @brief Terminal backend: writes to stdout.
+ */
+static int _kiloc_tty_write(void *ud, const char *buf, size_t len)
+{
+        (void)ud;
+        // Whatever the app printed through stdio comes first.
+        fflush(stdout);
+        return _kiloc_write_all(STDOUT_FILENO, buf, len);
+}
+
+/**
+ * @brief Terminal backend: queries the window size with ioctl(TIOCGWINSZ).
+ */
+static bool _kiloc_tty_size(void *ud, uint16_t *w, uint16_t *h)
 {
         struct winsize ws;
 
+        (void)ud;
         if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1)
                 return false;
+        *w = ws.ws_col;
+        *h = ws.ws_row;
+        return true;
+}
 
-        if (k->ter_w != ws.ws_col || k->ter_h != ws.ws_row) {
-                k->ter_w = ws.ws_col;
-                k->ter_h = ws.ws_row;
-                return true;
+/**
+ * @brief Terminal backend: reads from stdin.
+ */
+static ssize_t _kiloc_tty_read(void *ud, char *buf, size_t len)
+{
+        (void)ud;
+        return read(STDIN_FILENO, buf, len);
+}
+
+/* The default backend: the process's controlling terminal. */
+static const struct kiloc_backend _kiloc_tty = {
+        .write = _kiloc_tty_write,
+        .size = _kiloc_tty_size,
+        .read = _kiloc_tty_read,
+        .in_fd = STDIN_FILENO,
+        .tty = true,
+};
+
+/**
+ * @brief SIGWINCH handler used when the event loop is not running.
+ *
+ * Only sets an async-signal-safe flag; the query happens on the next frame.
+ */
+static void _kiloc_on_winch(int sig)
+{
+        (void)sig;
+        _kiloc_winch = 1;
+}
+
+/**
+ * @brief Applies a terminal size.
+ *
+ * A change sets k->resized, emits a KILOC_EV_RESIZE event and is recorded
+ * if input recording is active.
+ *
+ * @param w The terminal width.
+ * @param h The terminal height.
+ * @return True if the size changed.
+ */
+static bool _kiloc_set_tersize(uint16_t w, uint16_t h)
+{
+        if (k->ter_w == w && k->ter_h == h)
+                return false;
+
+        k->ter_w = w;
+        k->ter_h = h;
+        k->resized = true;
+        _kiloc_rec_resize(w, h);
+        if (k->cast) {
+                char size[16];
+                _kiloc_cast_put('r', size, (size_t)snprintf(size, sizeof(size), "%ux%u", w, h));
         }
 
-        return false;
+        struct kiloc_event ev = { .type = KILOC_EV_RESIZE };
+        ev.resize.w = w;
+        ev.resize.h = h;
+        _kiloc_emit(&ev);
+        return true;
+}
+
+/**
+ * @brief Checks for terminal window size changes.
+ *
+ * Asks the backend for the current terminal dimensions, but only after a
+ * SIGWINCH was received (or the backend reported a resize). While replaying a recording the recorded
+ * sizes are used instead.
+ *
+ * @return True if the terminal size has changed, false otherwise.
+ */
+static bool _kiloc_check_tersize(void)
+{
+        uint16_t w, h;
+
+        if (!_kiloc_winch || k->replay)
+                return false;
+        _kiloc_winch = 0;
+
+        if (!k->be->size(k->be->ud, &w, &h))
+                return false;
+
+        return _kiloc_set_tersize(w, h);
 }
 
 /**
@@ -45,19 +328,19 @@ static bool _kiloc_check_tersize(void)
  */
 static void _kiloc_draw_bound(void)
 {
-    if (!k->bdry || k->ter_w < k->max_w + 2 || k->ter_h < k->max_h + 2) return;
+    if (!k->bdry || k->mode == Inl || k->ter_w < k->max_w + 2 || k->ter_h < k->max_h + 2) return;
 
     uint16_t sx = k->offset_x + 1, sy = k->offset_y + 1;
     uint16_t ex = sx + k->max_w + 1, ey = sy + k->max_h + 1;
     
     // Top border: Corner + Horizontal line + Corner
-    printf("\033[%d;%dH%s", sy, sx, TOP_LEFT_CORNER); for (uint16_t i = 0; i < k->max_w; ++i) printf("%s", HORIZONTAL_LINE); printf("%s", TOP_RIGHT_CORNER);
+    _kiloc_printf("\033[%d;%dH%s", sy, sx, TOP_LEFT_CORNER); for (uint16_t i = 0; i < k->max_w; ++i) _kiloc_puts(HORIZONTAL_LINE); _kiloc_puts(TOP_RIGHT_CORNER);
 
     // Vertical lines: Left and Right side
-    for (uint16_t y = sy + 1; y < ey; ++y) printf("\033[%d;%dH%s\033[%d;%dH%s", y, sx, VERTICAL_LINE, y, ex, VERTICAL_LINE);
+    for (uint16_t y = sy + 1; y < ey; ++y) _kiloc_printf("\033[%d;%dH%s\033[%d;%dH%s", y, sx, VERTICAL_LINE, y, ex, VERTICAL_LINE);
 
     // Bottom border: Corner + Horizontal line + Corner 
-    printf("\033[%d;%dH%s", ey, sx, BOTTOM_LEFT_CORNER); for (uint16_t i = 0; i < k->max_w; ++i) printf("%s", HORIZONTAL_LINE); printf("%s", BOTTOM_RIGHT_CORNER);
+    _kiloc_printf("\033[%d;%dH%s", ey, sx, BOTTOM_LEFT_CORNER); for (uint16_t i = 0; i < k->max_w; ++i) _kiloc_puts(HORIZONTAL_LINE); _kiloc_puts(BOTTOM_RIGHT_CORNER);
 }
 
 /**
@@ -69,9 +352,12 @@ static void _kiloc_draw_bound(void)
 static void _kiloc_set_row_mode(void)
 {
         struct termios raw;
-        tcgetattr(STDIN_FILENO, &k->org_ter);
+        if (tcgetattr(STDIN_FILENO, &k->org_ter) == -1) return;
+        k->ter_saved = true;
         raw = k->org_ter;
         raw.c_lflag &= ~(ICANON | ECHO);
+        // Enter must arrive as CR (0x0A is Ctrl+J), and Ctrl-S/Ctrl-Q reach the app.
+        raw.c_iflag &= ~(ICRNL | IXON);
         raw.c_cc[VMIN] = 0;
         raw.c_cc[VTIME] = 0;
         tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
@@ -115,6 +401,123 @@ static int _kiloc_get_char_width(const char *s, int len)
 }
 
 
+/* Registered once per process; kiloc_init may run several times. */
+static bool _kiloc_atexit_set = false;
+
+/**
+ * @brief Allocates component memory from the arena.
+ *
+ * Component payloads live as long as the UI and are released together by
+ * kiloc_shutdown, so a bump allocator over large chunks is enough.
+ *
+ * @param size Number of bytes.
+ * @return The 16-byte aligned memory, or NULL on failure.
+ */
+static void *_kiloc_alloc(size_t size)
+{
+        struct kiloc_chunk *c = k->arena;
+
+        size = (size + 15) & ~(size_t)15;
+        if (c == NULL || c->used + size > c->cap) {
+                size_t cap = size > KILOC_CHUNK ? size : KILOC_CHUNK;
+                c = (struct kiloc_chunk *)malloc(sizeof(struct kiloc_chunk) + cap);
+                if (c == NULL) return NULL;
+                c->next = k->arena;
+                c->used = 0;
+                c->cap = cap;
+                k->arena = c;
+        }
+
+        void *p = c->data + c->used;
+        c->used += size;
+        return p;
+}
+
+/**
+ * @brief Builds the sequence undoing the terminal modes set by kiloc_init.
+ *
+ * Async-signal-safe (no stdio, no allocation).
+ *
+ * @param buf Destination of at least 128 bytes.
+ * @return Length of the sequence.
+ */
+static size_t _kiloc_restore_seq(char *buf)
+{
+        static const char reset[] = "\033[?1003l\033[?1000l\033[?1006l"      // Mouse off
+                                    "\033[?2004l"                            // Bracketed paste off
+                                    "\033[0m\033[?25h";                      // Reset style, show cursor
+        size_t n = 0;
+
+        if (k->kitty) {
+                memcpy(buf, "\033[<u", 4);                  // Pop the kitty keyboard flags
+                n = 4;
+        }
+        memcpy(buf + n, reset, sizeof(reset) - 1);
+        n += sizeof(reset) - 1;
+
+        if (k->mode == Inl) {
+                // Continue below the region, leaving the last frame in scrollback.
+                int rows = k->inl_h - 1 - k->inl_row;
+                if (rows > 0) {
+                        char digits[5];
+                        int d = 0;
+                        buf[n++] = '\033';
+                        buf[n++] = '[';
+                        do digits[d++] = (char)('0' + rows % 10); while ((rows /= 10) > 0);
+                        while (d > 0) buf[n++] = digits[--d];
+                        buf[n++] = 'B';
+                }
+                buf[n++] = '\r';
+                buf[n++] = '\n';
+        } else {
+                memcpy(buf + n, "\033[?1049l", 8);          // Back to the primary screen
+                n += 8;
+        }
+        return n;
+}
+
+/**
+ * @brief Restores the terminal modes changed by kiloc_init (Win and Inl modes).
+ *
+ * On the terminal backend this uses only write() and tcsetattr(), so it is
+ * async-signal-safe; other backends (never reached from a signal handler)
+ * get the sequence through their write callback.
+ */
+static void _kiloc_restore_tty(void)
+{
+        char buf[128];
+        size_t n = _kiloc_restore_seq(buf);
+
+        if (!k->be->tty) {
+                _kiloc_buf_put(&_kiloc_out, buf, n);
+                _kiloc_flush();
+                return;
+        }
+
+        _kiloc_write_all(STDOUT_FILENO, buf, n);
+        if (k->ter_saved)
+                tcsetattr(STDIN_FILENO, TCSAFLUSH, &k->org_ter);
+}
+
+/**
+ * @brief SIGINT/SIGTERM handler: restores the terminal, then re-raises the
+ * signal with its default action.
+ */
+static void _kiloc_on_fatal(int sig)
+{
+        _kiloc_restore_tty();
+        signal(sig, SIG_DFL);
+        raise(sig);
+}
+
+/**
+ * @brief atexit hook: shuts kiloc down if the app did not.
+ */
+static void _kiloc_atexit(void)
+{
+        kiloc_shutdown();
+}
+
 /* API */
 /**
  * @brief See header for details. Initializes the core framework.
@@ -131,25 +534,82 @@ void kiloc_init(uint16_t min_w, uint16_t min_h, uint16_t max_w, uint16_t max_h,
         k->max_w = max_w;
         k->max_h = max_h;
         k->bdry  = show_boundary;
+        k->mode  = mode;
+        k->n_cmp = num_comp;
 
-        // Initialize the front and back buffers.
-        k->b_buffer = (struct kiloc_cell **)calloc(max_h, sizeof(struct kiloc_cell *));
-        k->f_buffer = (struct kiloc_cell **)calloc(max_h, sizeof(struct kiloc_cell *));
+        // Output goes to the terminal unless kiloc_set_backend chose another backend.
+        if (k->be == NULL) k->be = &_kiloc_tty;
+        _kiloc_out.be = k->be;
+        _kiloc_out.err = false;
+        _kiloc_out.len = 0;
 
+        // No event loop resources yet (created on demand).
+        k->epfd = k->sigfd = k->frame_fd = -1;
+        k->winch_blocked = false;
+        k->rs_fd = -1;
+        k->fps = 60;
 
-        for (uint16_t y = 0; y < max_h; ++y) {
-                k->b_buffer[y] = (struct kiloc_cell *)calloc(max_w, sizeof(struct kiloc_cell));
-                k->f_buffer[y] = (struct kiloc_cell *)calloc(max_w, sizeof(struct kiloc_cell));
-                for (uint16_t x = 0; x < max_w; ++x) {
-                        strcpy(k->f_buffer[y][x].content, " ");
-                        strcpy(k->b_buffer[y][x].content, " ");
+        // Input parser starts in the ground state.
+        memset(&k->in, 0, sizeof(k->in));
+        k->in.esc_ms = 25;
+        k->in.esc_timer = -1;
+        k->kitty = false;
+        memset(&k->lat, 0, sizeof(k->lat));
+        k->lat_pending = 0;
+
+        // Capabilities start from environment hints; Win mode probes for the rest.
+        k->probing = false;
+        k->probe_timer = -1;
+        k->holding = false;
+        k->n_held = 0;
+        _kiloc_caps_hints();
+
+        // Not recording or replaying.
+        k->rec = NULL;
+        k->replay = NULL;
+        k->replay_fd = -1;
+
+        // Coalesce every bursty kind by default.
+        k->n_co = 0;
+        memset(&k->co_stats, 0, sizeof(k->co_stats));
+        for (int i = 0; i < KILOC_CO_COUNT; ++i)
+                k->co_on[i] = true;
+
+        // Nothing is focused until the app or the user moves the focus.
+        k->focus = 0;
+        k->focus_stale = true;
+
+        // No key bindings yet.
+        k->chord_n = 0;
+        k->chord_ms = 1000;
+        k->chord_timer = -1;
+
+        // Initialize the front and back buffers (one cell block each, so they free in bulk).
+        // Txt mode renders once without diffing, so it has no front buffer.
+        k->b_buffer = (struct kiloc_cell **)calloc(max_h, sizeof(struct kiloc_cell *));
+        struct kiloc_cell *b_cells = (struct kiloc_cell *)calloc((size_t)max_w * max_h, sizeof(struct kiloc_cell));
+        for (uint16_t y = 0; y < max_h; ++y)
+                k->b_buffer[y] = b_cells + (size_t)y * max_w;
+        _kiloc_clear_rows(0, max_h);
+
+        k->f_buffer = NULL;
+        if (mode == Win || mode == Inl) {
+                k->f_buffer = (struct kiloc_cell **)calloc(max_h, sizeof(struct kiloc_cell *));
+                struct kiloc_cell *f_cells = (struct kiloc_cell *)calloc((size_t)max_w * max_h, sizeof(struct kiloc_cell));
+                for (uint16_t y = 0; y < max_h; ++y) {
+                        k->f_buffer[y] = f_cells + (size_t)y * max_w;
+                        for (uint16_t x = 0; x < max_w; ++x)
+                                strcpy(k->f_buffer[y][x].content, " ");
                 }
+                k->live_rows = (uint8_t *)calloc(max_h, 1);
+                k->live_own = (uint16_t *)calloc((size_t)max_w * max_h, sizeof(uint16_t));
         }
 
         // Initialize component storage
         k->cids = (struct kiloc_cmp **)calloc(num_comp, sizeof(struct kiloc_cmp *));
         // The root component is abstracted as a container.
-        struct container *root_comp = (struct container *)malloc(sizeof(struct container));
+        k->arena = NULL;
+        struct container *root_comp = (struct container *)_kiloc_alloc(sizeof(struct container));
 
         k->root.cid = 0;
         k->root.pid = 0;
@@ -168,22 +628,162 @@ void kiloc_init(uint16_t min_w, uint16_t min_h, uint16_t max_w, uint16_t max_h,
         k->cids[k->root.cid] = &k->root;
 
         // Set terminal
-        if (mode == Win) {
-                printf("\033[2J");    // Clear terminal
-                printf("\033[?25l");  // Hide cursor
+        if (mode == Win || mode == Inl) {
+                // Set row mode first, so replies to the queries below are never echoed
+                if (k->be->tty) _kiloc_set_row_mode();
+
+                if (mode == Win) {
+                        _kiloc_puts("\033[?1049h"); // Enter the alternate screen (keeps the shell's scrollback intact)
+                        _kiloc_puts("\033[2J");    // Clear terminal
+                } else {
+                        // Start on a fresh line below the cursor and reserve the region there
+                        _kiloc_winch = 1;
+                        _kiloc_check_tersize();
+                        if (_kiloc_inline_cpr() != 1)
+                                _kiloc_puts("\r\n");
+                        _kiloc_inline_reserve();
+                }
+                _kiloc_puts("\033[?25l");  // Hide cursor
+                _kiloc_puts("\033[?2004h"); // Enable bracketed paste
+                if (k->be->tty) {
+                        _kiloc_puts("\033[?u");    // Query the kitty keyboard protocol (answered only if supported)
+                        _kiloc_caps_probe();      // Query the rest of the capabilities (answered asynchronously)
+                } else {
+                        k->caps.probed = true;    // Nobody answers; kiloc_set_caps may fill in the rest
+                }
+                _kiloc_flush();
+
+        }
+        if ((mode == Win || mode == Inl) && k->be->tty) {
+                // Re-query the terminal size only when it changes.
+                struct sigaction sa = { .sa_handler = _kiloc_on_winch, .sa_flags = SA_RESTART };
+                sigemptyset(&sa.sa_mask);
+                sigaction(SIGWINCH, &sa, NULL);
+
+                // Restore the terminal on SIGINT/SIGTERM and at exit.
+                struct sigaction fatal = { .sa_handler = _kiloc_on_fatal };
+                sigemptyset(&fatal.sa_mask);
+                sigaction(SIGINT, &fatal, &k->old_int);
+                sigaction(SIGTERM, &fatal, &k->old_term);
+                if (!_kiloc_atexit_set) {
+                        atexit(_kiloc_atexit);
+                        _kiloc_atexit_set = true;
+                }
+        }
+        _kiloc_winch = 1;
+        k->active = true;
+}
+
+/**
+ * @brief See header for details. Restores the terminal and releases everything.
+ */
+void kiloc_shutdown(void)
+{
+        if (!k->active) return;
+
+        if (k->mode == Win || k->mode == Inl)
+                _kiloc_restore_tty();
+        if ((k->mode == Win || k->mode == Inl) && k->be->tty) {
+                sigaction(SIGINT, &k->old_int, NULL);
+                sigaction(SIGTERM, &k->old_term, NULL);
+                signal(SIGWINCH, SIG_DFL);
+        }
+
+        // Remote session connections and sinks (unregistered from the event loop first).
+        _kiloc_remote_close();
+        _kiloc_sinks_close();
 
-                // Set row mode
-                _kiloc_set_row_mode();
+        // Event loop resources.
+        for (uint16_t i = 0; i < k->n_timers; ++i)
+                if (k->timers[i].fd >= 0) close(k->timers[i].fd);
+        free(k->timers);
+        free(k->watches);
+        _kiloc_loop_unblock();
+        if (k->sigfd >= 0) close(k->sigfd);
+        if (k->frame_fd >= 0) close(k->frame_fd);
+        if (k->replay_fd >= 0) close(k->replay_fd);
+        if (k->epfd >= 0) close(k->epfd);
+        free(k->replay);
+        for (uint32_t i = 0; i < k->n_held; ++i)
+                if (k->held[i].type == KILOC_EV_PASTE)
+                        free((char *)k->held[i].paste.data);
+        free(k->held);
+        k->held = NULL;
+        k->n_held = k->held_cap = 0;
+        kiloc_record_stop();
+        kiloc_cast_stop();
+
+        // Component tree: children arrays, then every payload in bulk. The
+        // components belong to the app and may be added again after a re-init.
+        for (uint16_t i = 0; i < k->n_cmp; ++i) {
+                if (k->cids[i] == NULL) continue;
+                free(k->cids[i]->children);
+                k->cids[i]->children = NULL;
+                k->cids[i]->child_count = 0;
+                k->cids[i]->parent = NULL;
+                k->cids[i]->self = NULL;
+        }
+        while (k->arena) {
+                struct kiloc_chunk *next = k->arena->next;
+                free(k->arena);
+                k->arena = next;
         }
+        free(k->cids);
+
+        // Buffers and indexes.
+        if (k->b_buffer) free(k->b_buffer[0]);
+        if (k->f_buffer) free(k->f_buffer[0]);
+        free(k->b_buffer);
+        free(k->f_buffer);
+        free(k->hit_map);
+        free(k->focus_chain);
+        free(k->bnodes);
+        free(k->bedges);
+        free(k->scope_root);
+        free(k->chord_node);
+        free(k->prof);
+        free(k->prof_cells);
+        free(k->live_rows);
+        free(k->live_own);
+        free(k->binds);
+
+        // Leave a clean state for a later kiloc_init.
+        memset(k, 0, sizeof(*k));
 }
 
 
+/* How a live frame updates a row (see _kiloc_live_patch). */
+#define LIVE_PATCHED    1       // Changed bindings were drawn over their own cells.
+#define LIVE_REDRAW     2       // The row is cleared and the tree redrawn on it.
+
+/* Owner of a cell drawn by several components. */
+#define LIVE_OWN_MANY   0xFFFF
+
+/**
+ * @brief Records that the component being drawn wrote a cell.
+ *
+ * Cells drawn outside the tree (overlays, the root) count as shared, so a
+ * live frame never patches over them.
+ */
+static inline void _kiloc_live_own(uint16_t x, uint16_t y)
+{
+        uint16_t *o = &k->live_own[(size_t)y * k->max_w + x];
+
+        if (k->draw_cid == 0)
+                *o = LIVE_OWN_MANY;
+        else if (*o == 0)
+                *o = k->draw_cid;
+        else if (*o != k->draw_cid)
+                *o = LIVE_OWN_MANY;
+}
+
 /**
  * @brief See header for details. Places a single char in the back buffer.
  */
 void kiloc_putchr(uint16_t x, uint16_t y, const char *content, uint64_t style)
 {
-        if (x >= k->max_w || y >= k->max_h)
+        // A live frame only redraws the rows marked for it.
+        if (x >= k->max_w || y >= k->max_h || (k->live && k->live_rows[y] != LIVE_REDRAW))
                 return;
 
         int len = _kiloc_get_utf8_len(content);
@@ -191,6 +791,11 @@ void kiloc_putchr(uint16_t x, uint16_t y, const char *content, uint64_t style)
 
         struct kiloc_cell *c = &k->b_buffer[y][x];
 
+        if (k->prof_cid)
+                _kiloc_prof_cell(x, y);
+        if (k->live_own)
+                _kiloc_live_own(x, y);
+
         if (len < 5) {
             strncpy(c->content, content, len);
             c->content[len] = '\0';
@@ -210,6 +815,9 @@ void kiloc_putstr(uint16_t x, uint16_t y, const char *content, uint64_t style)
         uint16_t cur_x = x;
         const char *ptr = content;
 
+        if (y >= k->max_h || (k->live && k->live_rows[y] != LIVE_REDRAW))
+                return;
+
         while (*ptr != '\0' && cur_x < k->max_w) {
                 int len = _kiloc_get_utf8_len(ptr);
                 if (len == 0)
@@ -227,6 +835,8 @@ void kiloc_putstr(uint16_t x, uint16_t y, const char *content, uint64_t style)
                     struct kiloc_cell *next_cell = &k->b_buffer[y][cur_x + 1];
                     next_cell->content[0] = '\0';
                     next_cell->style = style;
+                    if (k->live_own)
+                            _kiloc_live_own(cur_x + 1, y);
                 }
 
                 cur_x += width;
@@ -245,12 +855,15 @@ void kiloc_putstr(uint16_t x, uint16_t y, const char *content, uint64_t style)
 static struct container *_kiloc_cmp_container_init(struct kiloc_cmp *c);
 static struct text *_kiloc_cmp_text_init(struct kiloc_cmp *c);
 static struct box *_kiloc_cmp_box_init(struct kiloc_cmp *c);
+static struct binding *_kiloc_cmp_binding_init(struct kiloc_cmp *c);
 static void _kiloc_cmp_add_child(struct kiloc_cmp *p, struct kiloc_cmp *c);
 static void _kiloc_cmp_render(struct kiloc_cmp *c);
+static void _kiloc_cmp_draw(struct kiloc_cmp *c);
 static void _kiloc_cmp_root_render(struct kiloc_cmp *c);
 static void _kiloc_cmp_container_render(struct kiloc_cmp *c);
 static void _kiloc_cmp_text_render(struct kiloc_cmp* c);
 static void _kiloc_cmp_box_render(struct kiloc_cmp *c);
+static void _kiloc_cmp_binding_render(struct kiloc_cmp *c);
 
 /**
  * @brief Allocates and links the component-specific struct container.
@@ -259,7 +872,7 @@ static void _kiloc_cmp_box_render(struct kiloc_cmp *c);
  */
 static struct container *_kiloc_cmp_container_init(struct kiloc_cmp *c)
 {
-        c->self = (struct container *)malloc(sizeof(struct container));
+        c->self = (struct container *)_kiloc_alloc(sizeof(struct container));
         struct container *self = c->self;
 
         self->base = c;
@@ -273,7 +886,7 @@ static struct container *_kiloc_cmp_container_init(struct kiloc_cmp *c)
  */
 static struct text *_kiloc_cmp_text_init(struct kiloc_cmp *c)
 {
-        c->self = (struct text *)malloc(sizeof(struct text));
+        c->self = (struct text *)_kiloc_alloc(sizeof(struct text));
         struct text *s = c->self;
 
         s->base = c;
@@ -287,9 +900,32 @@ static struct text *_kiloc_cmp_text_init(struct kiloc_cmp *c)
  */
 static struct box *_kiloc_cmp_box_init(struct kiloc_cmp *c)
 {
-        c->self = (struct box *)malloc(sizeof(struct box));
+        c->self = (struct box *)_kiloc_alloc(sizeof(struct box));
         struct box *s = c->self;
 
+        s->focus_style = 0;
+        s->base = c;
+        return s;
+}
+
+/**
+ * @brief Allocates and links the component-specific struct binding.
+ *
+ * The value cache starts invalid so the first frame always formats.
+ *
+ * @param c The generic component base.
+ * @return The allocated struct binding pointer.
+ */
+static struct binding *_kiloc_cmp_binding_init(struct kiloc_cmp *c)
+{
+        c->self = (struct binding *)_kiloc_alloc(sizeof(struct binding));
+        struct binding *s = c->self;
+
+        s->ptr = NULL;
+        s->fmt = NULL;
+        s->atomic = false;
+        s->valid = false;
+        s->buf[0] = '\0';
         s->base = c;
         return s;
 }
@@ -309,13 +945,29 @@ static void _kiloc_cmp_add_child(struct kiloc_cmp *p, struct kiloc_cmp *c)
 }
 
 /**
- * @brief Renders a component by dispatching to the type-specific handler.
+ * @brief Renders a component, profiling it if a profiled frame is being rendered.
  * @param c The component to render.
  */
 static void _kiloc_cmp_render(struct kiloc_cmp *c)
 {
+        uint16_t parent = k->draw_cid;
+
         if (c == NULL) return;
 
+        k->draw_cid = c->cid;
+        if (k->prof_active && c->type != root)
+                _kiloc_prof_cmp(c);
+        else
+                _kiloc_cmp_draw(c);
+        k->draw_cid = parent;
+}
+
+/**
+ * @brief Renders a component by dispatching to the type-specific handler.
+ * @param c The component to render.
+ */
+static void _kiloc_cmp_draw(struct kiloc_cmp *c)
+{
         switch (c->type) {
                 case root:
                         _kiloc_cmp_root_render(c);
@@ -329,6 +981,9 @@ static void _kiloc_cmp_render(struct kiloc_cmp *c)
                 case box:
                         _kiloc_cmp_box_render(c);
                         break;
+                case binding:
+                        _kiloc_cmp_binding_render(c);
+                        break;
         }
 }
 
@@ -386,7 +1041,7 @@ static void _kiloc_cmp_box_render(struct kiloc_cmp *c)
 	uint16_t ay = c->abs_y;
 	uint16_t ex = ax + s->w - 1;
 	uint16_t ey = ay + s->h - 1;
-	uint64_t style = s->border_style;
+	uint64_t style = (c->focused && s->focus_style) ? s->focus_style : s->border_style;
         const char *h_line = HORIZONTAL_LINE;
         const char *v_line = VERTICAL_LINE;
 
@@ -460,84 +1115,546 @@ static void _kiloc_cmp_text_render(struct kiloc_cmp* c)
         kiloc_putstr(c->abs_x, c->abs_y, s->content, s->style);
 }
 
-
 /**
- * @brief Applies the ANSI Style Graphics Rendition (SGR) sequence based on the packed style word.
- * @param style The packed 64-bit style word.
+ * @brief Reads the raw bits of a binding's variable.
+ *
+ * 32-bit types are zero-extended so that equal values always produce equal bits.
+ *
+ * @param s The binding component data.
+ * @return The raw value bits.
  */
-static void _kiloc_apply_style(uint64_t style)
+static uint64_t _kiloc_bind_load(const struct binding *s)
 {
-    uint32_t fg_rgb = (uint32_t)((style >> 40) & 0xFFFFFF); 
-
-    uint32_t bg_rgb = (uint32_t)((style >> 16) & 0xFFFFFF); 
-
-    uint8_t flags = (uint8_t)(style & 0x7);
-
-    uint8_t fg_r = (fg_rgb >> 16) & 0xFF;
-    uint8_t fg_g = (fg_rgb >> 8) & 0xFF;
-    uint8_t fg_b = fg_rgb & 0xFF;
-    
-    uint8_t bg_r = (bg_rgb >> 16) & 0xFF;
-    uint8_t bg_g = (bg_rgb >> 8) & 0xFF;
-    uint8_t bg_b = bg_rgb & 0xFF;
+        switch (s->vtype) {
+                case KILOC_BIND_I32:
+                case KILOC_BIND_U32:
+                case KILOC_BIND_F32:
+                        if (s->atomic)
+                                return __atomic_load_n((const volatile uint32_t *)s->ptr, __ATOMIC_RELAXED);
+                        return *(const volatile uint32_t *)s->ptr;
+                case KILOC_BIND_I64:
+                case KILOC_BIND_U64:
+                case KILOC_BIND_F64:
+                        if (s->atomic)
+                                return __atomic_load_n((const volatile uint64_t *)s->ptr, __ATOMIC_RELAXED);
+                        return *(const volatile uint64_t *)s->ptr;
+        }
 
-    
-    // Reset (Start the sequence with \033[0)
-    fputs("\033[0", stdout);
-
-    // Apply style flags
-    if (flags & 0x1)
-        fputs(";1", stdout);
-    if (flags & 0x2)
-        fputs(";3", stdout);
-    if (flags & 0x4)
-        fputs(";4", stdout);
-
-    // Apply Foreground Color (True Color: \033[38;2;R;G;Bm)
-    if (fg_rgb != 0) {
-        printf(";38;2;%d;%d;%d", fg_r, fg_g, fg_b);
-    }
+        return 0;
+}
 
-    // Apply Background Color (True Color: \033[48;2;R;G;Bm)
-    if (bg_rgb != 0) {
-        printf(";48;2;%d;%d;%d", bg_r, bg_g, bg_b);
-    }
+/**
+ * @brief Formats raw value bits into the binding's cache using its format string.
+ * @param s The binding component data.
+ * @param bits The raw value bits from _kiloc_bind_load.
+ */
+static void _kiloc_bind_format(struct binding *s, uint64_t bits)
+{
+        uint32_t b32 = (uint32_t)bits;
+        float f32;
+        double f64;
 
-    // End the escape sequence
-    fputs("m", stdout);
+        switch (s->vtype) {
+                case KILOC_BIND_I32:
+                        snprintf(s->buf, KILOC_BIND_BUF, s->fmt ? s->fmt : "%d", (int32_t)b32);
+                        break;
+                case KILOC_BIND_U32:
+                        snprintf(s->buf, KILOC_BIND_BUF, s->fmt ? s->fmt : "%u", b32);
+                        break;
+                case KILOC_BIND_I64:
+                        snprintf(s->buf, KILOC_BIND_BUF, s->fmt ? s->fmt : "%lld", (long long)bits);
+                        break;
+                case KILOC_BIND_U64:
+                        snprintf(s->buf, KILOC_BIND_BUF, s->fmt ? s->fmt : "%llu", (unsigned long long)bits);
+                        break;
+                case KILOC_BIND_F32:
+                        memcpy(&f32, &b32, sizeof(f32));
+                        snprintf(s->buf, KILOC_BIND_BUF, s->fmt ? s->fmt : "%g", (double)f32);
+                        break;
+                case KILOC_BIND_F64:
+                        memcpy(&f64, &bits, sizeof(f64));
+                        snprintf(s->buf, KILOC_BIND_BUF, s->fmt ? s->fmt : "%g", f64);
+                        break;
+        }
 }
 
-/* API */
 /**
- * @brief See header for details. Packs individual style parameters into a 64-bit word.
+ * @brief Remembers a binding drawn by a full frame, for the live frames after it.
+ * @param c The binding component.
  */
-uint64_t kiloc_make_style(uint32_t fg_rgb, uint32_t bg_rgb, 
-                          bool bold, bool italic, bool underline)
+static void _kiloc_bind_track(struct kiloc_cmp *c)
 {
-        uint64_t style = 0;
-        if (bold) {
-        style |= STYLE_BOLD;
-        }
-        if (italic) {
-        style |= STYLE_ITALIC;
-        }
-        if (underline) {
-        style |= STYLE_UNDERLINE;
+        if (k->n_binds == k->bind_cap) {
+                uint32_t cap = k->bind_cap ? k->bind_cap * 2 : 64;
+                struct kiloc_cmp **binds = realloc(k->binds, cap * sizeof(*binds));
+                // Without the full list, the next frames cannot be live.
+                if (binds == NULL) {
+                        k->live_ok = false;
+                        return;
+                }
+                k->binds = binds;
+                k->bind_cap = cap;
         }
-        style |= ((uint64_t)bg_rgb << 16);
-        style |= ((uint64_t)fg_rgb << 40);
-
-        return style;
+        k->binds[k->n_binds++] = c;
 }
 
-
-
 /**
- * @brief See header for details. Registers the component into the framework.
+ * @brief Calculates the absolute position of a binding and outputs its value.
+ *
+ * The variable is only re-formatted when its bits changed since the last frame.
+ * A live frame skips bindings outside the rows it redraws; a full frame
+ * records every binding for the live frames after it.
+ *
+ * @param c The binding component.
+ */
+static void _kiloc_cmp_binding_render(struct kiloc_cmp *c)
+{
+        struct binding *s = (struct binding *)c->self;
+        uint16_t pid = c->pid;
+
+        if (pid > 0) {
+                c->abs_x = k->cids[pid]->abs_x + s->x;
+                c->abs_y = k->cids[pid]->abs_y + s->y;
+        } else {
+                c->abs_x = s->x;
+                c->abs_y = s->y;
+        }
+
+        if (k->live) {
+                if (c->abs_y >= k->max_h || k->live_rows[c->abs_y] != LIVE_REDRAW) return;
+        } else {
+                _kiloc_bind_track(c);
+        }
+        if (s->ptr == NULL) return;
+
+        uint64_t bits = _kiloc_bind_load(s);
+        if (!s->valid || bits != s->last) {
+                _kiloc_bind_format(s, bits);
+                s->last = bits;
+                s->valid = true;
+        }
+
+        kiloc_putstr(c->abs_x, c->abs_y, s->buf, s->style);
+}
+
+
+/* Longest SGR sequence _kiloc_sgr produces, plus the terminator. */
+#define KILOC_SGR_MAX 64
+
+/* Typical size of a cursor move, weighed against ECH which leaves the cursor behind. */
+#define KILOC_CUP_COST 8
+
+/**
+ * @brief Returns true if two cells hold the same content and style.
+ */
+static inline bool _kiloc_cell_eq(const struct kiloc_cell *a, const struct kiloc_cell *b)
+{
+        return a->style == b->style && strcmp(a->content, b->content) == 0;
+}
+
+/**
+ * @brief Returns the number of decimal digits of n.
+ */
+static int _kiloc_digits(unsigned n)
+{
+        int d = 1;
+
+        while (n >= 10) {
+                n /= 10;
+                ++d;
+        }
+        return d;
+}
+
+/**
+ * @brief Maps a color to the nearest entry of the xterm 256-color palette.
+ *
+ * Picks the closer of the 6x6x6 color cube and the 24-step gray ramp.
+ *
+ * @param rgb Color as 0xRRGGBB.
+ * @return Palette index (16-255).
+ */
+static uint8_t _kiloc_color_256(uint32_t rgb)
+{
+        static const int level[6] = { 0, 95, 135, 175, 215, 255 };
+        int c[3] = { (rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF };
+        int idx[3], cube = 0, gray = 0;
+
+        for (int i = 0; i < 3; ++i) {
+                idx[i] = c[i] < 48 ? 0 : c[i] < 115 ? 1 : (c[i] - 35) / 40;
+                cube += (c[i] - level[idx[i]]) * (c[i] - level[idx[i]]);
+        }
+
+        // Gray ramp entries 232-255 are 8, 18, ..., 238.
+        int avg = (c[0] + c[1] + c[2]) / 3;
+        int g = avg < 8 ? 0 : avg > 238 ? 23 : (avg - 3) / 10;
+        for (int i = 0; i < 3; ++i)
+                gray += (c[i] - (8 + 10 * g)) * (c[i] - (8 + 10 * g));
+
+        if (gray < cube)
+                return (uint8_t)(232 + g);
+        return (uint8_t)(16 + 36 * idx[0] + 6 * idx[1] + idx[2]);
+}
+
+/**
+ * @brief Formats ";<v>" for an SGR parameter (0-255).
+ * @return Number of bytes written.
+ */
+static inline int _kiloc_sgr_num(char *dst, uint32_t v)
+{
+        int n = 0;
+
+        dst[n++] = ';';
+        if (v >= 100) dst[n++] = (char)('0' + v / 100);
+        if (v >= 10) dst[n++] = (char)('0' + v / 10 % 10);
+        dst[n++] = (char)('0' + v % 10);
+        return n;
+}
+
+/**
+ * @brief Formats the ANSI Select Graphic Rendition (SGR) sequence for a packed style word.
+ * @param dst Receives the sequence (KILOC_SGR_MAX bytes, NUL-terminated).
+ * @param style The packed 64-bit style word.
+ * @param truecolor Use 24-bit colors (otherwise the 256-color palette).
+ * @return Length of the sequence.
+ */
+static int _kiloc_sgr(char *dst, uint64_t style, bool truecolor)
+{
+        uint32_t fg_rgb = (uint32_t)((style >> 40) & 0xFFFFFF);
+        uint32_t bg_rgb = (uint32_t)((style >> 16) & 0xFFFFFF);
+        int n = 3;
+
+        // Reset, then the style flags
+        memcpy(dst, "\033[0", 3);
+        if (style & STYLE_BOLD) { dst[n++] = ';'; dst[n++] = '1'; }
+        if (style & STYLE_ITALIC) { dst[n++] = ';'; dst[n++] = '3'; }
+        if (style & STYLE_UNDERLINE) { dst[n++] = ';'; dst[n++] = '4'; }
+
+        // Foreground and background (38;2;R;G;B / 48;2;R;G;B, or 38;5;N / 48;5;N without truecolor)
+        for (int i = 0; i < 2; ++i) {
+                uint32_t rgb = i == 0 ? fg_rgb : bg_rgb;
+                if (rgb == 0) continue;
+
+                dst[n++] = ';';
+                dst[n++] = i == 0 ? '3' : '4';
+                dst[n++] = '8';
+                if (truecolor) {
+                        memcpy(dst + n, ";2", 2);
+                        n += 2;
+                        n += _kiloc_sgr_num(dst + n, rgb >> 16);
+                        n += _kiloc_sgr_num(dst + n, (rgb >> 8) & 0xFF);
+                        n += _kiloc_sgr_num(dst + n, rgb & 0xFF);
+                } else {
+                        memcpy(dst + n, ";5", 2);
+                        n += 2;
+                        n += _kiloc_sgr_num(dst + n, _kiloc_color_256(rgb));
+                }
+        }
+
+        dst[n++] = 'm';
+        dst[n] = '\0';
+        return n;
+}
+
+/**
+ * @brief Applies the ANSI Style Graphics Rendition (SGR) sequence based on the packed style word.
+ * @param b The output buffer.
+ * @param style The packed 64-bit style word.
+ * @param truecolor Use 24-bit colors.
+ */
+static void _kiloc_apply_style(struct kiloc_buf *b, uint64_t style, bool truecolor)
+{
+        char sgr[KILOC_SGR_MAX];
+
+        _kiloc_buf_put(b, sgr, (size_t)_kiloc_sgr(sgr, style, truecolor));
+}
+
+/**
+ * @brief Resets rows of the back buffer to blank, default-style cells.
+ * @param from First row.
+ * @param to One past the last row.
+ */
+static void _kiloc_clear_rows(uint16_t from, uint16_t to)
+{
+        for (uint16_t y = from; y < to; ++y) {
+                for (uint16_t x = 0; x < k->max_w; ++x) {
+                        strcpy(k->b_buffer[y][x].content, " ");
+                        k->b_buffer[y][x].style = 0;
+                }
+        }
+}
+
+/**
+ * @brief Returns a cell's style, with never-drawn front buffer cells as default.
+ */
+static inline uint64_t _kiloc_cell_style(const struct kiloc_cell *c)
+{
+        return c->style == (uint64_t)-1 ? 0 : c->style;
+}
+
+/**
+ * @brief Serializes one buffer row as text.
+ *
+ * SGR is only emitted where the style changes, trailing blank cells are
+ * dropped and the row ends with a newline (after a reset if styled).
+ *
+ * @param b The output buffer.
+ * @param row The row.
+ * @param w Number of cells in the row.
+ * @param sgr_on False for plain text without any SGR.
+ */
+static void _kiloc_txt_row(struct kiloc_buf *b, const struct kiloc_cell *row, uint16_t w, bool sgr_on)
+{
+        char sgr[KILOC_SGR_MAX];
+        uint64_t cur = 0;
+        uint16_t end = w;
+
+        while (end > 0 && (!sgr_on || _kiloc_cell_style(&row[end - 1]) == 0)
+               && (row[end - 1].content[0] == ' ' || row[end - 1].content[0] == '\0'))
+                --end;
+
+        for (uint16_t x = 0; x < end; ++x) {
+                const struct kiloc_cell *c = &row[x];
+                uint64_t style = _kiloc_cell_style(c);
+
+                // The right half of a wide character was written with its left half.
+                if (c->content[0] == '\0') continue;
+
+                if (sgr_on && style != cur) {
+                        _kiloc_buf_put(b, sgr, (size_t)_kiloc_sgr(sgr, style, k->caps.truecolor));
+                        cur = style;
+                }
+                _kiloc_buf_put(b, c->content, strlen(c->content));
+        }
+
+        if (cur != 0)
+                _kiloc_buf_put(b, "\033[0m", 4);
+        _kiloc_buf_put(b, "\n", 1);
+}
+
+/**
+ * @brief One-shot Txt mode frame: renders the tree once and streams it to the backend.
+ *
+ * There is no front buffer, no diffing and no cursor addressing.
+ */
+static void _kiloc_render_txt(void)
+{
+        _kiloc_clear_rows(0, k->max_h);
+        _kiloc_cmp_render(&k->root);
+
+        for (uint16_t y = 0; y < k->max_h; ++y)
+                _kiloc_txt_row(&_kiloc_out, k->b_buffer[y], k->max_w, true);
+        _kiloc_flush();
+}
+
+/**
+ * @brief Updates the bindings whose value changed since they were drawn (live frames).
+ *
+ * A binding whose old and new cells were drawn by nobody else is patched in
+ * place: its old cells are blanked and the new value drawn over them, as a
+ * full frame would. Otherwise its row is marked for a redraw of the tree.
+ *
+ * @return True if some row must be redrawn from the tree.
+ */
+static bool _kiloc_live_patch(void)
+{
+        bool redraw = false;
+
+        memset(k->live_rows, 0, k->max_h);
+        for (uint32_t i = 0; i < k->n_binds; ++i) {
+                struct kiloc_cmp *c = k->binds[i];
+                struct binding *s = (struct binding *)c->self;
+                uint16_t x = c->abs_x, y = c->abs_y, ow, nw;
+
+                if (s->ptr == NULL || x >= k->max_w || y >= k->max_h || k->live_rows[y] == LIVE_REDRAW)
+                        continue;
+
+                uint64_t bits = _kiloc_bind_load(s);
+                if (s->valid && bits == s->last)
+                        continue;
+
+                ow = s->valid ? _kiloc_str_width(s->buf) : 0;
+                _kiloc_bind_format(s, bits);
+                s->last = bits;
+                s->valid = true;
+                nw = _kiloc_str_width(s->buf);
+
+                uint16_t *own = &k->live_own[(size_t)y * k->max_w];
+                uint32_t end = (uint32_t)x + (ow > nw ? ow : nw);
+                uint32_t j;
+
+                if (end > k->max_w) end = k->max_w;
+                for (j = x; j < end && (own[j] == 0 || own[j] == c->cid); ++j);
+                if (j < end) {
+                        k->live_rows[y] = LIVE_REDRAW;
+                        redraw = true;
+                        continue;
+                }
+
+                for (j = x; j < end; ++j) {
+                        if (own[j] != c->cid) continue;
+                        strcpy(k->b_buffer[y][j].content, " ");
+                        k->b_buffer[y][j].style = 0;
+                        own[j] = 0;
+                }
+                k->draw_cid = c->cid;
+                kiloc_putstr(x, y, s->buf, s->style);
+                k->draw_cid = 0;
+                k->live_rows[y] = LIVE_PATCHED;
+        }
+        return redraw;
+}
+
+/* Where and for which terminal a frame is encoded (see _kiloc_encode). */
+struct kiloc_enc {
+        struct kiloc_buf *b;                    // Destination.
+        const struct kiloc_caps *caps;          // Sequences the terminal understands.
+        uint16_t ox, oy;                        // Screen position of the canvas.
+        uint16_t rows, cols;                    // Part of the canvas drawn.
+        uint16_t ter_w;                         // Terminal width (the cursor wraps past it).
+        uint16_t *inl_row;                      // Cursor row within the inline region (NULL: absolute moves).
+        const uint8_t *dirty;                   // Rows that may differ (NULL: all rows).
+        uint64_t *style_ns;                     // Time spent encoding SGR is added here (NULL: not timed).
+        uint32_t *cells;                        // Changed cells drawn are counted here (NULL: not counted).
+};
+
+/**
+ * @brief Encodes the difference between two frames as terminal output.
+ *
+ * The terminal cursor and SGR state are tracked so that only sequences that
+ * change something are sent.
+ *
+ * @param e Destination and terminal.
+ * @param old The frame on screen, or NULL if the screen is blank and unknown.
+ * @param cur The new frame.
+ * @param commit Copy the drawn cells into old as they are encoded.
+ */
+static void _kiloc_encode(const struct kiloc_enc *e, struct kiloc_cell **old, struct kiloc_cell **cur, bool commit)
+{
+        static const struct kiloc_cell unknown = { .style = (uint64_t)-1 };
+        int cur_x = -1, cur_y = -1;
+        uint64_t cur_style = (uint64_t)-1;
+
+        for (uint16_t y = 0; y < e->rows; ++y) {
+                if (e->dirty && !e->dirty[y]) continue;
+
+                struct kiloc_cell *frow = old ? old[y] : NULL;
+                struct kiloc_cell *brow = cur[y];
+
+                for (uint16_t x = 0; x < e->cols; ) {
+                        const struct kiloc_cell *f = frow ? &frow[x] : &unknown;
+                        struct kiloc_cell *b = &brow[x];
+
+                        // Only output if content or style has changed
+                        if (_kiloc_cell_eq(f, b)) {
+                                ++x;
+                                continue;
+                        }
+
+                        // The right half of a wide character is drawn by its left half.
+                        if (b->content[0] == '\0') {
+                                if (commit) frow[x] = *b;
+                                ++x;
+                                continue;
+                        }
+
+                        // Position the cursor (row/column needs +1) unless it is already there
+                        int sx = e->ox + x, sy = e->oy + y;
+                        if (sx != cur_x || sy != cur_y) {
+                                if (e->inl_row)
+                                        _kiloc_inline_move(e->b, e->inl_row, sx, sy);
+                                else
+                                        _kiloc_buf_printf(e->b, "\033[%d;%dH", sy + 1, sx + 1);
+                        }
+
+                        // Apply style
+                        if (b->style != cur_style) {
+                                uint64_t t = e->style_ns ? _kiloc_now_ns() : 0;
+                                _kiloc_apply_style(e->b, b->style, e->caps->truecolor);
+                                if (e->style_ns) *e->style_ns += _kiloc_now_ns() - t;
+                                cur_style = b->style;
+                        }
+
+                        // Changed cells repeating this one can share a single REP or ECH.
+                        int len = (int)strlen(b->content);
+                        int w = (unsigned char)b->content[0] < 0x80 ? 1 : _kiloc_get_char_width(b->content, len);
+                        uint16_t run = 1;
+                        if (w == 1)
+                                while (x + run < e->cols && _kiloc_cell_eq(&brow[x + run], b)
+                                       && !(frow && _kiloc_cell_eq(&frow[x + run], b)))
+                                        ++run;
+
+                        int seq = 3 + _kiloc_digits(run);
+                        bool blank = strcmp(b->content, " ") == 0
+                                     && (b->style & (0xFFFFFFULL << 16 | STYLE_UNDERLINE)) == 0;
+
+                        if (run > 1 && e->caps->rep && seq < len * (run - 1)) {
+                                // Print the character once, then REP it.
+                                _kiloc_buf_printf(e->b, "%s\033[%ub", b->content, run - 1);
+                                cur_x = sx + run;
+                        } else if (blank && e->caps->ech && seq + KILOC_CUP_COST < run) {
+                                // Erase in place; the cursor does not move.
+                                _kiloc_buf_printf(e->b, "\033[%uX", run);
+                                cur_x = sx;
+                        } else {
+                                for (uint16_t i = 0; i < run; ++i)
+                                        _kiloc_buf_put(e->b, b->content, (size_t)len);
+                                cur_x = sx + run - 1 + w;
+                        }
+                        cur_y = sy;
+
+                        // Past the last column the cursor waits to wrap; its position is unreliable.
+                        if (cur_x >= e->ter_w)
+                                cur_x = -1;
+
+                        if (e->cells) *e->cells += run;
+
+                        // Update the front buffer
+                        if (commit)
+                                for (uint16_t i = 0; i < run; ++i)
+                                        frow[x + i] = brow[x + i];
+                        x += run;
+                }
+        }
+
+        // Ensure the style is reset to default after rendering to prevent polluting the terminal prompt
+        if (cur_style != 0 && cur_style != (uint64_t)-1)
+                _kiloc_buf_put(e->b, "\033[0m", 4);
+}
+
+/* API */
+/**
+ * @brief See header for details. Packs individual style parameters into a 64-bit word.
+ */
+uint64_t kiloc_make_style(uint32_t fg_rgb, uint32_t bg_rgb, 
+                          bool bold, bool italic, bool underline)
+{
+        uint64_t style = 0;
+        if (bold) {
+        style |= STYLE_BOLD;
+        }
+        if (italic) {
+        style |= STYLE_ITALIC;
+        }
+        if (underline) {
+        style |= STYLE_UNDERLINE;
+        }
+        style |= ((uint64_t)bg_rgb << 16);
+        style |= ((uint64_t)fg_rgb << 40);
+
+        return style;
+}
+
+
+
+/**
+ * @brief See header for details. Registers the component into the framework.
  */
 void *kiloc_addcmp (struct kiloc_cmp *c)
 {         
         k->cids[c->cid] = c;
+        c->focused = false;
+        k->focus_stale = true;
         if (c->pid > 0)
                 _kiloc_cmp_add_child(k->cids[c->pid], c);
         else if (c->pid == 0 && c->cid != 0)
@@ -552,6 +1669,8 @@ void *kiloc_addcmp (struct kiloc_cmp *c)
                         return _kiloc_cmp_text_init(c);
                 case box:
                         return _kiloc_cmp_box_init(c);
+                case binding:
+                        return _kiloc_cmp_binding_init(c);
         }
 
         return NULL;
@@ -564,9 +1683,46 @@ void *kiloc_addcmp (struct kiloc_cmp *c)
 void kiloc_render(void)
 {
         uint16_t x, y;
-        // Check for terminal size changes
-        if (_kiloc_check_tersize()) {
-                printf("\033[2J");
+        bool timed = k->frame_timing || k->ft_overlay;
+        uint64_t ph[KILOC_PH_COUNT] = { 0 }, start = 0, lap = 0;
+        uint64_t sent = _kiloc_out.sent + _kiloc_out.len;
+        uint32_t cells = 0;
+
+        if (k->mode == Txt) {
+                _kiloc_render_txt();
+                return;
+        }
+        if (k->mode == Str) {
+                for (uint16_t i = 0; i < k->root.child_count; ++i)
+                        kiloc_stream(k->root.children[i]);
+                return;
+        }
+        if (timed)
+                start = _kiloc_now_ns();
+
+        // Outside the event loop, pick up the probe replies that arrived so far.
+        if (k->probing && !k->running)
+                _kiloc_caps_poll();
+
+        // Apply a pending resize (signalled by SIGWINCH, never polled)
+        _kiloc_check_tersize();
+        _kiloc_coalesce_flush();
+
+        // Let the terminal present the whole frame at once.
+        if (k->caps.sync)
+                _kiloc_puts("\033[?2026h");
+
+        // A live frame needs the back buffer of the last full frame, as it was drawn.
+        bool live = k->live && k->live_ok && !k->resized && k->rc == NULL && !k->cmp_prof
+                    && !k->overdraw_overlay && !k->lat_overlay && !k->ft_overlay;
+        k->live = false;
+
+        if (k->resized) {
+                k->resized = false;
+                if (k->mode == Inl)
+                        _kiloc_inline_clear();
+                else
+                        _kiloc_printf("\033[2J");
                 // Force a full screen redraw, reset the front buffer, and apply default style.
                 for (y = 0; y < k->max_h; ++y)
                         for (x = 0; x < k->max_w; ++x) {
@@ -576,59 +1732,4888 @@ void kiloc_render(void)
                         }
         }
 
-        // Calculate offsets and check minimum size requirements (this logic remains unchanged)
-        k->offset_x = (k->ter_w > k->max_w + (k->bdry ? 2 : 0)) ? (k->ter_w - (k->max_w + (k->bdry ? 2 : 0))) / 2 : 0;
-        k->offset_y = (k->ter_h > k->max_h + (k->bdry ? 2 : 0)) ? (k->ter_h - (k->max_h + (k->bdry ? 2 : 0))) / 2 : 0;
+        // Calculate offsets and check minimum size requirements (the inline region is
+        // left-aligned and clipped to the terminal instead)
+        uint16_t rows = k->max_h, cols = k->max_w;
+        if (k->mode == Inl) {
+                k->offset_x = k->offset_y = 0;
+                rows = k->inl_h;
+                if (k->ter_w < cols) cols = k->ter_w;
+        } else {
+                k->offset_x = (k->ter_w > k->max_w + (k->bdry ? 2 : 0)) ? (k->ter_w - (k->max_w + (k->bdry ? 2 : 0))) / 2 : 0;
+                k->offset_y = (k->ter_h > k->max_h + (k->bdry ? 2 : 0)) ? (k->ter_h - (k->max_h + (k->bdry ? 2 : 0))) / 2 : 0;
+        }
 
-        if (k->ter_w < k->min_w || k->ter_h < k->min_h) {
-                printf("\033[1;1HPlease resize your terminal to at least %d x %d to view this content. :)\n", k->min_w, k->min_h);
-                fflush(stdout);
+        if (k->mode != Inl && (k->ter_w < k->min_w || k->ter_h < k->min_h)) {
+                _kiloc_printf("\033[1;1HPlease resize your terminal to at least %d x %d to view this content. :)\n", k->min_w, k->min_h);
+                k->live_ok = false;
+                if (k->caps.sync)
+                        _kiloc_puts("\033[?2026l");
+                _kiloc_flush();
+                _kiloc_lat_frame();
                 return;
         }
 
-        // Clear the back buffer (b_buffer)
-        for (uint16_t y = 0; y < k->max_h; ++y) {
-                for (uint16_t x = 0; x < k->max_w; ++x) {
-                        strcpy(k->b_buffer[y][x].content, " ");
-                        k->b_buffer[y][x].style = 0;
+        // Clear the back buffer (b_buffer) and render components to it. An attached
+        // client keeps the server's cells there instead; a live frame only
+        // redraws the rows of changed bindings.
+        if (timed)
+                lap = _kiloc_now_ns();
+        if (live) {
+                if (_kiloc_live_patch()) {
+                        for (y = 0; y < k->max_h; ++y) {
+                                if (k->live_rows[y] != LIVE_REDRAW) continue;
+                                _kiloc_clear_rows(y, y + 1);
+                                memset(&k->live_own[(size_t)y * k->max_w], 0, k->max_w * sizeof(uint16_t));
+                        }
+                        if (timed)
+                                ph[KILOC_PH_CLEAR] = _kiloc_ft_lap(&lap);
+                        k->live = true;
+                        _kiloc_cmp_render(&k->root);
+                        k->live = false;
                 }
+                k->hit_stale = true;
+        } else if (k->rc == NULL) {
+                _kiloc_clear_rows(0, k->max_h);
+                if (timed)
+                        ph[KILOC_PH_CLEAR] = _kiloc_ft_lap(&lap);
+                if (k->cmp_prof || k->overdraw_overlay)
+                        _kiloc_prof_begin();
+                k->n_binds = 0;
+                k->live_ok = k->live_rows != NULL && k->live_own != NULL
+                             && !k->lat_overlay && !k->ft_overlay && !k->overdraw_overlay;
+                if (k->live_own)
+                        memset(k->live_own, 0, (size_t)k->max_w * k->max_h * sizeof(uint16_t));
+                _kiloc_cmp_render(&k->root);
+                if (k->prof_active) {
+                        k->prof_active = false;
+                        if (k->overdraw_overlay)
+                                _kiloc_prof_overlay();
+                }
+                k->hit_stale = true;
         }
 
-        // Render components to b_buffer
-        _kiloc_cmp_render(&k->root);
+        if (k->lat_overlay)
+                _kiloc_lat_overlay();
+        if (k->ft_overlay)
+                _kiloc_ft_overlay();
+        if (timed)
+                ph[KILOC_PH_CMP] = _kiloc_ft_lap(&lap);
 
-        // Double-buffering comparison and rendering
-        for (y = 0; y < k->max_h; ++y) {
-                for (x = 0; x < k->max_w; ++x) {
-                        struct kiloc_cell *f = &k->f_buffer[y][x];
-                        struct kiloc_cell *b = &k->b_buffer[y][x];
+        // Fan the diff out first: the sinks' encodings need the previous frame in f_buffer.
+        if (k->n_sinks)
+                _kiloc_sinks_frame(rows, cols, live ? k->live_rows : NULL);
 
-                        // Only output if content or style has changed
-                        if (strcmp(f->content, b->content) != 0 || f->style != b->style) {
-                                // Position the cursor (row/column needs +1)
-                                printf("\033[%d;%dH", k->offset_y + y + 1, k->offset_x + x + 1);
+        // Double-buffering comparison and rendering.
+        struct kiloc_enc e = {
+                .b = &_kiloc_out, .caps = &k->caps, .ox = k->offset_x, .oy = k->offset_y,
+                .rows = rows, .cols = cols, .ter_w = k->ter_w,
+                .inl_row = k->mode == Inl ? &k->inl_row : NULL,
+                .dirty = live ? k->live_rows : NULL,
+                .style_ns = timed ? &ph[KILOC_PH_STYLE] : NULL, .cells = &cells,
+        };
+        if (timed)
+                lap = _kiloc_now_ns();
+        _kiloc_encode(&e, k->f_buffer, k->b_buffer, true);
+        if (timed)
+                ph[KILOC_PH_DIFF] = _kiloc_ft_lap(&lap) - ph[KILOC_PH_STYLE];
 
-                                // Apply style
-                                _kiloc_apply_style(b->style);
+        // Draw the window boundary (unchanged since the last full frame in a live one)
+        if (!live)
+                _kiloc_draw_bound();
+        if (k->caps.sync)
+                _kiloc_puts("\033[?2026l");
 
-                                // Print content
-                                printf("%s", b->content);
+        // Flush output
+        if (timed)
+                lap = _kiloc_now_ns();
+        _kiloc_flush();
+        if (timed)
+                ph[KILOC_PH_FLUSH] = _kiloc_ft_lap(&lap);
 
-                                // Update the front buffer
-                                strcpy(f->content, b->content);
-                                f->style = b->style;
-                        }
-                }
+        // Send the frame to attached clients, record a keyframe if one is due.
+        if (k->rs_fd >= 0)
+                _kiloc_rs_frame();
+        if (k->cast)
+                _kiloc_cast_frame(rows, cols);
+
+        if (timed) {
+                ph[KILOC_PH_FRAME] = _kiloc_now_ns() - start;
+                _kiloc_ft_frame(ph, start, _kiloc_out.sent + _kiloc_out.len - sent, cells);
         }
 
-        // Ensure the style is reset to default after rendering to prevent polluting the terminal prompt
-        fputs("\033[0m", stdout);
+        // The pending input is now on screen.
+        _kiloc_lat_frame();
+}
 
-        // Draw the window boundary
-        _kiloc_draw_bound();
 
-        // Flush output
-        fflush(stdout);
+
+
+/*-------- Event loop APIs --------*/
+/* Kinds of epoll sources, stored in the high half of epoll_event.data.u64. */
+#define EP_TTY          1ULL
+#define EP_SIG          2ULL
+#define EP_FRAME        3ULL
+#define EP_TIMER        4ULL
+#define EP_WATCH        5ULL
+#define EP_REPLAY       6ULL
+#define EP_TAG(kind, idx)  (((kind) << 32) | (uint32_t)(idx))
+
+/* Terminal read buffer; large so that paste bursts take few syscalls. */
+#define KILOC_READ_BUF  65536
+
+/* Frame period while a bracketed paste is in flight. */
+#define KILOC_PASTE_FRAME_NS    100000000ULL
+
+/* Static */
+
+/**
+ * @brief Returns the current monotonic time in nanoseconds.
+ */
+static uint64_t _kiloc_now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Delivers an event: input goes to the components first, everything
+ * else (and unhandled input) to the application callback, if any.
+ * @param ev The event.
+ */
+static void _kiloc_deliver(const struct kiloc_event *ev)
+{
+        // Its handlers may change more than bindings.
+        if (ev->type != KILOC_EV_FRAME)
+                k->delivered = true;
+
+        if (_kiloc_rc_route(ev) || _kiloc_focus_route(ev))
+                return;
+
+        if (k->on_event)
+                k->on_event(ev, k->ud);
+}
+
+/**
+ * @brief Holds an input event read by kiloc_render until the application
+ * takes input (see _kiloc_hold_release). Paste bytes are copied.
+ * @param ev The event.
+ */
+static void _kiloc_hold(const struct kiloc_event *ev)
+{
+        struct kiloc_event h = *ev;
+
+        if (k->n_held == k->held_cap) {
+                uint32_t cap = k->held_cap ? k->held_cap * 2 : 16;
+                struct kiloc_event *held = (struct kiloc_event *)realloc(k->held, cap * sizeof(*held));
+
+                if (held == NULL) return;
+                k->held = held;
+                k->held_cap = cap;
+        }
+        if (h.type == KILOC_EV_PASTE) {
+                char *data = h.paste.len ? (char *)malloc(h.paste.len) : NULL;
+
+                if (h.paste.len && data == NULL) return;
+                if (data)
+                        memcpy(data, ev->paste.data, h.paste.len);
+                h.paste.data = data;
+        }
+        k->held[k->n_held++] = h;
 }
 
+/**
+ * @brief Emits the held input events, in arrival order.
+ */
+static void _kiloc_hold_release(void)
+{
+        struct kiloc_event *held = k->held;
+        uint32_t n = k->n_held;
+
+        // Handlers may feed more input; detach the queue first.
+        k->held = NULL;
+        k->n_held = k->held_cap = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+                _kiloc_emit(&held[i]);
+                if (held[i].type == KILOC_EV_PASTE)
+                        free((char *)held[i].paste.data);
+        }
+        free(held);
+}
+
+/**
+ * @brief Emits an event. Bursty kinds are coalesced until the next frame; any
+ * other event first delivers the coalesced ones to keep the order.
+ * @param ev The event.
+ */
+static void _kiloc_emit(const struct kiloc_event *ev)
+{
+        // Nobody is listening yet: kiloc_render is reading probe replies.
+        if (k->holding) {
+                _kiloc_hold(ev);
+                return;
+        }
+        if (_kiloc_coalesce_add(ev))
+                return;
+
+        _kiloc_coalesce_flush();
+        _kiloc_deliver(ev);
+}
 
+/**
+ * @brief Adds an fd to the epoll instance with a kind/index tag.
+ * @return 0 on success, -1 on error.
+ */
+static int _kiloc_ep_add(int fd, uint32_t events, uint64_t tag)
+{
+        struct epoll_event ev = { .events = events, .data.u64 = tag };
+        return epoll_ctl(k->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/**
+ * @brief Creates the epoll instance and frame timer on first use.
+ * @return 0 on success, -1 on error.
+ */
+static int _kiloc_loop_setup(void)
+{
+        if (k->epfd >= 0) return 0;
+
+        k->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (k->epfd == -1) return -1;
+
+        k->frame_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (k->frame_fd == -1 || _kiloc_ep_add(k->frame_fd, EPOLLIN, EP_TAG(EP_FRAME, 0)) == -1)
+                return -1;
+
+        return 0;
+}
+
+/**
+ * @brief Registers the backend's input fd and SIGWINCH with the epoll instance.
+ *
+ * SIGWINCH is blocked and received through a signalfd so that it wakes
+ * epoll_wait like any other fd (terminal backend only). The signalfd is kept
+ * across runs; the signal is blocked again on each one.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int _kiloc_loop_attach_tty(void)
+{
+        sigset_t mask, old;
+
+        if (k->be->tty && !k->winch_blocked) {
+                sigemptyset(&mask);
+                sigaddset(&mask, SIGWINCH);
+                if (sigprocmask(SIG_BLOCK, &mask, &old) == -1) return -1;
+                // Left alone if the caller had it blocked already.
+                k->winch_blocked = !sigismember(&old, SIGWINCH);
+        }
+
+        if (k->sigfd < 0 && k->be->tty) {
+                sigemptyset(&mask);
+                sigaddset(&mask, SIGWINCH);
+                k->sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+                if (k->sigfd == -1 || _kiloc_ep_add(k->sigfd, EPOLLIN, EP_TAG(EP_SIG, 0)) == -1)
+                        return -1;
+        }
+
+        // Already registered by an earlier kiloc_run is fine.
+        if (k->be->in_fd >= 0 && _kiloc_ep_add(k->be->in_fd, EPOLLIN, EP_TAG(EP_TTY, 0)) == -1
+            && errno != EPERM && errno != EEXIST)
+                return -1;
+
+        return 0;
+}
+
+/**
+ * @brief Unblocks SIGWINCH if kiloc_run blocked it; the handler installed by
+ * kiloc_init then picks up resizes until the next run.
+ */
+static void _kiloc_loop_unblock(void)
+{
+        sigset_t mask;
+
+        if (!k->winch_blocked) return;
+
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGWINCH);
+        sigprocmask(SIG_UNBLOCK, &mask, NULL);
+        k->winch_blocked = false;
+}
+
+/**
+ * @brief Arms a timerfd with a relative expiration in nanoseconds.
+ * @param fd The timerfd.
+ * @param ns Time until the first expiration (0 disarms).
+ * @param interval_ns Repeat interval (0 for one-shot).
+ */
+static void _kiloc_arm(int fd, uint64_t ns, uint64_t interval_ns)
+{
+        struct itimerspec its = {
+                .it_value    = { .tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL },
+                .it_interval = { .tv_sec = interval_ns / 1000000000ULL, .tv_nsec = interval_ns % 1000000000ULL },
+        };
+        timerfd_settime(fd, 0, &its, NULL);
+}
+
+/**
+ * @brief Renders a frame and records its time.
+ */
+static void _kiloc_loop_frame(void)
+{
+        struct kiloc_event ev = { .type = KILOC_EV_FRAME };
+        // A continuous tick nobody asked for, with no event handled since the
+        // last frame, only refreshes bindings.
+        bool live = k->continuous && !k->frame_req;
+
+        k->frame_req = false;
+        _kiloc_rec_frame();
+        _kiloc_emit(&ev);       // Also delivers the events coalesced since the last frame.
+        k->live = live && !k->frame_req && !k->delivered;
+        k->delivered = false;
+        kiloc_render();
+        k->live = false;
+        k->last_frame = _kiloc_now_ns();
+}
+
+/**
+ * @brief Renders now if a frame is due, otherwise arms the frame timer.
+ *
+ * Keeps input-to-frame latency minimal when the frame budget allows, and
+ * leaves the frame timer disarmed while idle so the process fully sleeps.
+ */
+static void _kiloc_loop_schedule(void)
+{
+        // A replay renders where the recording did (see _kiloc_replay_step).
+        if ((!k->frame_req && !k->continuous) || k->replay) {
+                if (k->frame_armed) {
+                        _kiloc_arm(k->frame_fd, 0, 0);
+                        k->frame_armed = false;
+                }
+                return;
+        }
+
+        uint64_t period = 1000000000ULL / k->fps;
+        if (k->pasting && period < KILOC_PASTE_FRAME_NS)
+                period = KILOC_PASTE_FRAME_NS;
+        uint64_t now = _kiloc_now_ns();
+        uint64_t due = k->last_frame + period;
+
+        if (now >= due) {
+                _kiloc_loop_frame();
+                due = k->last_frame + period;
+                if (!k->frame_req && !k->continuous) {
+                        _kiloc_arm(k->frame_fd, 0, 0);
+                        k->frame_armed = false;
+                        return;
+                }
+                now = _kiloc_now_ns();
+        }
+
+        _kiloc_arm(k->frame_fd, due > now ? due - now : 1, 0);
+        k->frame_armed = true;
+}
+
+/**
+ * @brief ESC timeout callback: the ESC was not followed by a sequence.
+ */
+static void _kiloc_loop_esc_expired(int id, void *ud)
+{
+        (void)ud;
+        if (k->in.esc_timer == id)
+                k->in.esc_timer = -1;
+        kiloc_input_flush();
+}
+
+/**
+ * @brief Arms the ESC timeout while the parser waits inside an escape
+ * sequence, and cancels it otherwise.
+ */
+static void _kiloc_loop_esc_timer(void)
+{
+        if (k->in.esc_timer >= 0) {
+                kiloc_del_timer(k->in.esc_timer);
+                k->in.esc_timer = -1;
+        }
+
+        // A replay has the recorded flushes instead.
+        if (_kiloc_input_pending() && !k->replay)
+                k->in.esc_timer = kiloc_add_timer(k->in.esc_ms, false, _kiloc_loop_esc_expired, NULL);
+}
+
+/**
+ * @brief Reads all available terminal input and delivers it.
+ */
+static void _kiloc_loop_read_tty(void)
+{
+        static char buf[KILOC_READ_BUF];
+        bool got = false;
+        ssize_t n;
+
+        while ((n = k->be->read(k->be->ud, buf, sizeof(buf))) > 0) {
+                got = true;
+                // Live input is ignored while a recording is replayed.
+                if (k->replay) continue;
+                kiloc_input_feed(buf, (size_t)n);
+                k->frame_req = true;
+
+                if ((size_t)n < sizeof(buf)) break;
+        }
+
+        _kiloc_loop_esc_timer();
+
+        // Readable but empty on the first read means end of input (e.g. a closed pipe).
+        if (n == 0 && !got)
+                epoll_ctl(k->epfd, EPOLL_CTL_DEL, k->be->in_fd, NULL);
+}
+
+/**
+ * @brief Drains the SIGWINCH signalfd.
+ */
+static void _kiloc_loop_read_sig(void)
+{
+        struct signalfd_siginfo si;
+
+        while (read(k->sigfd, &si, sizeof(si)) == sizeof(si))
+                _kiloc_winch = 1;
+
+        // Query once per burst and tell the app before the next frame.
+        if (_kiloc_check_tersize())
+                k->frame_req = true;
+}
+
+/**
+ * @brief Runs a timer's callback; one-shot timers are released first so the
+ * callback may re-register.
+ * @param id The timer ID.
+ */
+static void _kiloc_loop_fire_timer(uint32_t id)
+{
+        struct kiloc_timer t = k->timers[id];
+
+        if (!t.repeat)
+                kiloc_del_timer((int)id);
+        t.cb((int)id, t.ud);
+}
+
+/* API */
+/**
+ * @brief See header for details. The event loop.
+ */
+int kiloc_run(void (*on_event)(const struct kiloc_event *ev, void *ud), void *ud)
+{
+        struct epoll_event evs[32];
+
+        k->on_event = on_event;
+        k->ud = ud;
+
+        if (_kiloc_loop_setup() == -1 || _kiloc_loop_attach_tty() == -1) {
+                _kiloc_loop_unblock();
+                return -1;
+        }
+        _kiloc_caps_arm();
+
+        k->running = true;
+        if (k->n_held)
+                _kiloc_hold_release();
+        k->frame_req = true;
+        _kiloc_loop_schedule();
+
+        while (k->running) {
+                int n = epoll_wait(k->epfd, evs, 32, -1);
+                if (n == -1) {
+                        if (errno == EINTR) continue;
+                        k->running = false;
+                        _kiloc_loop_unblock();
+                        return -1;
+                }
+
+                for (int i = 0; i < n && k->running; ++i) {
+                        uint64_t kind = evs[i].data.u64 >> 32;
+                        uint32_t idx = (uint32_t)evs[i].data.u64;
+                        uint64_t exp;
+
+                        switch (kind) {
+                                case EP_TTY:
+                                        _kiloc_loop_read_tty();
+                                        break;
+                                case EP_SIG:
+                                        _kiloc_loop_read_sig();
+                                        break;
+                                case EP_FRAME:
+                                        if (read(k->frame_fd, &exp, sizeof(exp)) == sizeof(exp))
+                                                k->frame_armed = false;
+                                        break;
+                                case EP_TIMER:
+                                        if (idx < k->n_timers && k->timers[idx].fd >= 0
+                                            && read(k->timers[idx].fd, &exp, sizeof(exp)) == sizeof(exp))
+                                                _kiloc_loop_fire_timer(idx);
+                                        break;
+                                case EP_REPLAY:
+                                        if (read(k->replay_fd, &exp, sizeof(exp)) == sizeof(exp))
+                                                _kiloc_replay_step();
+                                        break;
+                                case EP_WATCH:
+                                        if (idx < k->n_watches && k->watches[idx].fd >= 0)
+                                                k->watches[idx].cb(k->watches[idx].fd, evs[i].events, k->watches[idx].ud);
+                                        break;
+                        }
+                }
+
+                if (k->running)
+                        _kiloc_loop_schedule();
+        }
+
+        _kiloc_loop_unblock();
+        return 0;
+}
+
+/**
+ * @brief See header for details. Stops the event loop.
+ */
+void kiloc_quit(void)
+{
+        k->running = false;
+}
+
+/**
+ * @brief See header for details. Marks a frame as pending.
+ */
+void kiloc_request_frame(void)
+{
+        k->frame_req = true;
+}
+
+/**
+ * @brief See header for details. Configures frame pacing.
+ */
+void kiloc_set_fps(uint16_t fps, bool continuous)
+{
+        k->fps = fps ? fps : 60;
+        k->continuous = continuous;
+}
+
+/**
+ * @brief See header for details. Creates a timerfd-backed timer.
+ */
+int kiloc_add_timer(uint32_t ms, bool repeat, void (*cb)(int id, void *ud), void *ud)
+{
+        uint16_t id;
+
+        if (cb == NULL || _kiloc_loop_setup() == -1) return -1;
+
+        // Reuse a free slot if there is one.
+        for (id = 0; id < k->n_timers; ++id)
+                if (k->timers[id].fd < 0) break;
+
+        if (id == k->n_timers) {
+                struct kiloc_timer *t = realloc(k->timers, (k->n_timers + 1) * sizeof(struct kiloc_timer));
+                if (t == NULL) return -1;
+                k->timers = t;
+                k->n_timers++;
+        }
+
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd == -1) {
+                k->timers[id].fd = -1;
+                return -1;
+        }
+        if (_kiloc_ep_add(fd, EPOLLIN, EP_TAG(EP_TIMER, id)) == -1) {
+                close(fd);
+                k->timers[id].fd = -1;
+                return -1;
+        }
+
+        k->timers[id].fd = fd;
+        k->timers[id].cb = cb;
+        k->timers[id].ud = ud;
+        k->timers[id].repeat = repeat;
+
+        uint64_t ns = (uint64_t)(ms ? ms : 1) * 1000000ULL;
+        _kiloc_arm(fd, ns, repeat ? ns : 0);
+        return id;
+}
+
+/**
+ * @brief See header for details. Closes a timer's timerfd.
+ */
+void kiloc_del_timer(int id)
+{
+        if (id < 0 || id >= k->n_timers || k->timers[id].fd < 0) return;
+
+        close(k->timers[id].fd);        // Closing also removes it from epoll.
+        k->timers[id].fd = -1;
+}
+
+/**
+ * @brief See header for details. Watches a user fd.
+ */
+int kiloc_add_fd(int fd, uint32_t events, void (*cb)(int fd, uint32_t events, void *ud), void *ud)
+{
+        uint16_t i;
+
+        if (cb == NULL || _kiloc_loop_setup() == -1) return -1;
+
+        for (i = 0; i < k->n_watches; ++i)
+                if (k->watches[i].fd < 0) break;
+
+        if (i == k->n_watches) {
+                struct kiloc_watch *w = realloc(k->watches, (k->n_watches + 1) * sizeof(struct kiloc_watch));
+                if (w == NULL) return -1;
+                k->watches = w;
+                k->watches[i].fd = -1;
+                k->n_watches++;
+        }
+
+        if (_kiloc_ep_add(fd, events, EP_TAG(EP_WATCH, i)) == -1)
+                return -1;
+
+        k->watches[i].fd = fd;
+        k->watches[i].cb = cb;
+        k->watches[i].ud = ud;
+        return 0;
+}
+
+/**
+ * @brief See header for details. Stops watching a user fd.
+ */
+void kiloc_del_fd(int fd)
+{
+        for (uint16_t i = 0; i < k->n_watches; ++i) {
+                if (k->watches[i].fd == fd) {
+                        epoll_ctl(k->epfd, EPOLL_CTL_DEL, fd, NULL);
+                        k->watches[i].fd = -1;
+                        return;
+                }
+        }
+}
+
+
+/*-------- Input APIs --------*/
+/* Parser states. */
+enum {
+        S_GROUND,       // Between sequences.
+        S_ESC,          // After ESC.
+        S_CSI,          // Inside ESC [ ... (parameters).
+        S_SS3,          // After ESC O.
+        S_UTF8,         // Inside a multi-byte UTF-8 character.
+        S_DCS,          // Inside ESC P ... (device control string).
+        S_DCS_ESC,      // After ESC inside a DCS (expecting '\\').
+        S_COUNT,
+        S_PASTE = S_COUNT       // Inside a bracketed paste (scanned outside the table).
+};
+
+/* Sequence terminating a bracketed paste. */
+static const char _kiloc_paste_end[] = "\033[201~";
+#define PASTE_END_LEN   (sizeof(_kiloc_paste_end) - 1)
+
+/* Byte classes. */
+enum {
+        CL_C0,          // 0x00-0x1F except ESC
+        CL_ESC,         // 0x1B
+        CL_DIGIT,       // '0'-'9'
+        CL_SEP,         // ':' ';'
+        CL_PRIV,        // '<' '=' '>' '?'
+        CL_INTER,       // 0x20-0x2F
+        CL_LBR,         // '['
+        CL_O,           // 'O'
+        CL_P,           // 'P'
+        CL_BSL,         // '\\'
+        CL_FINAL,       // Other 0x40-0x7E
+        CL_DEL,         // 0x7F
+        CL_CONT,        // UTF-8 continuation byte
+        CL_L2,          // UTF-8 lead of a 2-byte character
+        CL_L3,          // UTF-8 lead of a 3-byte character
+        CL_L4,          // UTF-8 lead of a 4-byte character
+        CL_BAD,         // Never valid in UTF-8
+        CL_COUNT
+};
+
+/* Parser actions. */
+enum {
+        A_NONE,         // Just change state.
+        A_PRINT,        // Emit the byte as a text key.
+        A_CTRL,         // Emit a C0 control key.
+        A_DEL,          // Emit Backspace.
+        A_ESC,          // Emit a lone Escape key.
+        A_CSI,          // Start a CSI/SS3 sequence.
+        A_DIGIT,        // Accumulate a parameter digit.
+        A_SEP,          // Start the next parameter.
+        A_PRIV,         // Record the private marker.
+        A_INTER,        // Record an intermediate byte.
+        A_CSI_END,      // Dispatch a CSI sequence.
+        A_SS3_END,      // Dispatch an SS3 sequence.
+        A_ALT,          // ESC + byte: reprocess the byte as an Alt key.
+        A_U2,           // Start a 2-byte UTF-8 character.
+        A_U3,           // Start a 3-byte UTF-8 character.
+        A_U4,           // Start a 4-byte UTF-8 character.
+        A_UCONT,        // Continue a UTF-8 character.
+        A_UBAD,         // Broken UTF-8: emit U+FFFD and reprocess the byte.
+        A_BAD,          // Drop an invalid byte.
+        A_DCS,          // Start a DCS.
+        A_DCS_PUT,      // Collect a DCS byte.
+        A_DCS_END       // Dispatch a DCS.
+};
+
+/* A state machine transition: action to run and state to enter. */
+struct _kiloc_trans {
+        uint8_t act, next;
+};
+
+/* Maps every byte to its class. */
+static const uint8_t _kiloc_in_class[256] = {
+        [0x00 ... 0x1A] = CL_C0,
+        [0x1B]          = CL_ESC,
+        [0x1C ... 0x1F] = CL_C0,
+        [0x20 ... 0x2F] = CL_INTER,
+        [0x30 ... 0x39] = CL_DIGIT,
+        [0x3A ... 0x3B] = CL_SEP,
+        [0x3C ... 0x3F] = CL_PRIV,
+        [0x40 ... 0x4E] = CL_FINAL,
+        ['O']           = CL_O,
+        ['P']           = CL_P,
+        [0x51 ... 0x5A] = CL_FINAL,
+        ['[']           = CL_LBR,
+        ['\\']          = CL_BSL,
+        [0x5D ... 0x7E] = CL_FINAL,
+        [0x7F]          = CL_DEL,
+        [0x80 ... 0xBF] = CL_CONT,
+        [0xC0 ... 0xC1] = CL_BAD,
+        [0xC2 ... 0xDF] = CL_L2,
+        [0xE0 ... 0xEF] = CL_L3,
+        [0xF0 ... 0xF4] = CL_L4,
+        [0xF5 ... 0xFF] = CL_BAD,
+};
+
+#define T(a, n) { a, n }
+/* Transitions per state and byte class. */
+static const struct _kiloc_trans _kiloc_in_trans[S_COUNT][CL_COUNT] = {
+        [S_GROUND] = {
+                [CL_C0]    = T(A_CTRL, S_GROUND),    [CL_ESC]   = T(A_NONE, S_ESC),
+                [CL_DIGIT] = T(A_PRINT, S_GROUND),   [CL_SEP]   = T(A_PRINT, S_GROUND),
+                [CL_PRIV]  = T(A_PRINT, S_GROUND),   [CL_INTER] = T(A_PRINT, S_GROUND),
+                [CL_LBR]   = T(A_PRINT, S_GROUND),   [CL_O]     = T(A_PRINT, S_GROUND),
+                [CL_P]     = T(A_PRINT, S_GROUND),   [CL_BSL]   = T(A_PRINT, S_GROUND),
+                [CL_FINAL] = T(A_PRINT, S_GROUND),   [CL_DEL]   = T(A_DEL, S_GROUND),
+                [CL_CONT]  = T(A_BAD, S_GROUND),     [CL_L2]    = T(A_U2, S_UTF8),
+                [CL_L3]    = T(A_U3, S_UTF8),        [CL_L4]    = T(A_U4, S_UTF8),
+                [CL_BAD]   = T(A_BAD, S_GROUND),
+        },
+        [S_ESC] = {
+                [CL_C0]    = T(A_ALT, S_GROUND),     [CL_ESC]   = T(A_ESC, S_ESC),
+                [CL_DIGIT] = T(A_ALT, S_GROUND),     [CL_SEP]   = T(A_ALT, S_GROUND),
+                [CL_PRIV]  = T(A_ALT, S_GROUND),     [CL_INTER] = T(A_ALT, S_GROUND),
+                [CL_LBR]   = T(A_CSI, S_CSI),        [CL_O]     = T(A_CSI, S_SS3),
+                [CL_P]     = T(A_DCS, S_DCS),        [CL_BSL]   = T(A_ALT, S_GROUND),
+                [CL_FINAL] = T(A_ALT, S_GROUND),     [CL_DEL]   = T(A_ALT, S_GROUND),
+                [CL_CONT]  = T(A_ESC, S_GROUND),     [CL_L2]    = T(A_ALT, S_GROUND),
+                [CL_L3]    = T(A_ALT, S_GROUND),     [CL_L4]    = T(A_ALT, S_GROUND),
+                [CL_BAD]   = T(A_ESC, S_GROUND),
+        },
+        [S_CSI] = {
+                [CL_C0]    = T(A_NONE, S_CSI),       [CL_ESC]   = T(A_NONE, S_ESC),
+                [CL_DIGIT] = T(A_DIGIT, S_CSI),      [CL_SEP]   = T(A_SEP, S_CSI),
+                [CL_PRIV]  = T(A_PRIV, S_CSI),       [CL_INTER] = T(A_INTER, S_CSI),
+                [CL_LBR]   = T(A_CSI_END, S_GROUND), [CL_O]     = T(A_CSI_END, S_GROUND),
+                [CL_P]     = T(A_CSI_END, S_GROUND), [CL_BSL]   = T(A_CSI_END, S_GROUND),
+                [CL_FINAL] = T(A_CSI_END, S_GROUND), [CL_DEL]   = T(A_NONE, S_CSI),
+                [CL_CONT]  = T(A_BAD, S_GROUND),     [CL_L2]    = T(A_BAD, S_GROUND),
+                [CL_L3]    = T(A_BAD, S_GROUND),     [CL_L4]    = T(A_BAD, S_GROUND),
+                [CL_BAD]   = T(A_BAD, S_GROUND),
+        },
+        [S_SS3] = {
+                [CL_C0]    = T(A_BAD, S_GROUND),     [CL_ESC]   = T(A_NONE, S_ESC),
+                [CL_DIGIT] = T(A_DIGIT, S_SS3),      [CL_SEP]   = T(A_SEP, S_SS3),
+                [CL_PRIV]  = T(A_BAD, S_GROUND),     [CL_INTER] = T(A_BAD, S_GROUND),
+                [CL_LBR]   = T(A_SS3_END, S_GROUND), [CL_O]     = T(A_SS3_END, S_GROUND),
+                [CL_P]     = T(A_SS3_END, S_GROUND), [CL_BSL]   = T(A_SS3_END, S_GROUND),
+                [CL_FINAL] = T(A_SS3_END, S_GROUND), [CL_DEL]   = T(A_BAD, S_GROUND),
+                [CL_CONT]  = T(A_BAD, S_GROUND),     [CL_L2]    = T(A_BAD, S_GROUND),
+                [CL_L3]    = T(A_BAD, S_GROUND),     [CL_L4]    = T(A_BAD, S_GROUND),
+                [CL_BAD]   = T(A_BAD, S_GROUND),
+        },
+        [S_UTF8] = {
+                [CL_C0]    = T(A_UBAD, S_GROUND),    [CL_ESC]   = T(A_UBAD, S_GROUND),
+                [CL_DIGIT] = T(A_UBAD, S_GROUND),    [CL_SEP]   = T(A_UBAD, S_GROUND),
+                [CL_PRIV]  = T(A_UBAD, S_GROUND),    [CL_INTER] = T(A_UBAD, S_GROUND),
+                [CL_LBR]   = T(A_UBAD, S_GROUND),    [CL_O]     = T(A_UBAD, S_GROUND),
+                [CL_P]     = T(A_UBAD, S_GROUND),    [CL_BSL]   = T(A_UBAD, S_GROUND),
+                [CL_FINAL] = T(A_UBAD, S_GROUND),    [CL_DEL]   = T(A_UBAD, S_GROUND),
+                [CL_CONT]  = T(A_UCONT, S_UTF8),     [CL_L2]    = T(A_UBAD, S_GROUND),
+                [CL_L3]    = T(A_UBAD, S_GROUND),    [CL_L4]    = T(A_UBAD, S_GROUND),
+                [CL_BAD]   = T(A_UBAD, S_GROUND),
+        },
+        [S_DCS] = {
+                [CL_C0]    = T(A_DCS_PUT, S_DCS),    [CL_ESC]   = T(A_NONE, S_DCS_ESC),
+                [CL_DIGIT] = T(A_DCS_PUT, S_DCS),    [CL_SEP]   = T(A_DCS_PUT, S_DCS),
+                [CL_PRIV]  = T(A_DCS_PUT, S_DCS),    [CL_INTER] = T(A_DCS_PUT, S_DCS),
+                [CL_LBR]   = T(A_DCS_PUT, S_DCS),    [CL_O]     = T(A_DCS_PUT, S_DCS),
+                [CL_FINAL] = T(A_DCS_PUT, S_DCS),    [CL_DEL]   = T(A_DCS_PUT, S_DCS),
+                [CL_CONT]  = T(A_DCS_PUT, S_DCS),    [CL_L2]    = T(A_DCS_PUT, S_DCS),
+                [CL_L3]    = T(A_DCS_PUT, S_DCS),    [CL_L4]    = T(A_DCS_PUT, S_DCS),
+                [CL_BAD]   = T(A_DCS_PUT, S_DCS),
+        },
+        [S_DCS_ESC] = {
+                // Only ESC \ (ST) is valid here; anything else abandons the string.
+                [CL_BSL]   = T(A_DCS_END, S_GROUND),
+        },
+};
+#undef T
+
+/* Static */
+static void _kiloc_mouse_report(uint32_t b, uint32_t col, uint32_t row, bool release);
+
+/**
+ * @brief Delivers a key event, applying a pending ESC (Alt) prefix.
+ *
+ * Release events are dropped unless the app enabled k->key_release.
+ *
+ * @param code Code point or enum kiloc_key value.
+ * @param mods KILOC_MOD_* bits.
+ * @param action enum kiloc_key_action.
+ */
+static void _kiloc_input_key_ev(uint32_t code, uint8_t mods, uint8_t action)
+{
+        struct kiloc_event ev = { .type = KILOC_EV_KEY };
+
+        if (action == KILOC_KEY_RELEASE && !k->key_release)
+                return;
+        ev.ts = k->in_ts;
+
+        if (k->in.alt) {
+                mods |= KILOC_MOD_ALT;
+                k->in.alt = false;
+        }
+        ev.key.code = code;
+        ev.key.mods = mods;
+        ev.key.action = action;
+        _kiloc_emit(&ev);
+}
+
+/**
+ * @brief Delivers a key press.
+ * @param code Code point or enum kiloc_key value.
+ * @param mods KILOC_MOD_* bits.
+ */
+static void _kiloc_input_key(uint32_t code, uint8_t mods)
+{
+        _kiloc_input_key_ev(code, mods, KILOC_KEY_PRESS);
+}
+
+/**
+ * @brief Delivers a C0 control byte as a key.
+ *
+ * Tab, Enter and Escape keep their codes; other controls become Ctrl + letter.
+ *
+ * @param b The control byte.
+ */
+static void _kiloc_input_ctrl(uint8_t b)
+{
+        switch (b) {
+                case 0x09:
+                case 0x0D:
+                        _kiloc_input_key(b, 0);
+                        break;
+                case 0x0A:
+                        _kiloc_input_key(KILOC_KEY_ENTER, KILOC_MOD_CTRL);
+                        break;
+                case 0x00:
+                        _kiloc_input_key(' ', KILOC_MOD_CTRL);
+                        break;
+                default:
+                        _kiloc_input_key(b < 0x1B ? b + 'a' - 1 : b + '@', KILOC_MOD_CTRL);
+                        break;
+        }
+}
+
+/**
+ * @brief Delivers a paste event to the focused component (or the app).
+ * @param data The bytes.
+ * @param len Number of bytes.
+ * @param flags KILOC_PASTE_* flags.
+ */
+static void _kiloc_input_paste_emit(const char *data, size_t len, uint8_t flags)
+{
+        struct kiloc_event ev = { .type = KILOC_EV_PASTE };
+
+        if (len == 0 && flags == 0) return;
+        ev.ts = k->in_ts;
+        ev.paste.data = data;
+        ev.paste.len = len;
+        ev.paste.flags = flags;
+        _kiloc_emit(&ev);
+}
+
+/**
+ * @brief Consumes paste payload up to the terminator or the end of the buffer.
+ *
+ * Payload is delivered as slices of the input buffer, so a paste of any size
+ * costs no copies and no allocation. The terminator may span reads.
+ *
+ * @param b Current position.
+ * @param end End of the buffer.
+ * @return The new position.
+ */
+static const uint8_t *_kiloc_input_paste(const uint8_t *b, const uint8_t *end)
+{
+        struct kiloc_parser *p = &k->in;
+
+        while (b < end) {
+                // Continue matching a terminator prefix.
+                if (p->paste_match > 0) {
+                        if (*b == (uint8_t)_kiloc_paste_end[p->paste_match]) {
+                                ++b;
+                                if (++p->paste_match == PASTE_END_LEN) {
+                                        p->paste_match = 0;
+                                        p->state = S_GROUND;
+                                        k->pasting = false;
+                                        _kiloc_input_paste_emit(NULL, 0, KILOC_PASTE_END);
+                                        return b;
+                                }
+                                continue;
+                        }
+                        // False alarm: the matched prefix was payload.
+                        _kiloc_input_paste_emit(_kiloc_paste_end, p->paste_match, 0);
+                        p->paste_match = 0;
+                }
+
+                const uint8_t *esc = memchr(b, 0x1B, (size_t)(end - b));
+                const uint8_t *stop = esc ? esc : end;
+
+                _kiloc_input_paste_emit((const char *)b, (size_t)(stop - b), 0);
+                b = stop;
+                if (esc) {
+                        p->paste_match = 1;
+                        ++b;
+                }
+        }
+
+        return b;
+}
+
+/**
+ * @brief Returns a value of a CSI parameter field.
+ *
+ * Fields are separated by ';', sub-values within a field by ':'
+ * (e.g. "97;5:3" is field 0 = {97}, field 1 = {5, 3}).
+ *
+ * @param field Field index.
+ * @param sub Sub-value index within the field.
+ * @param def Value returned if the field or sub-value is missing or empty.
+ */
+static uint32_t _kiloc_input_field(uint8_t field, uint8_t sub, uint32_t def)
+{
+        struct kiloc_parser *p = &k->in;
+        int f = -1, s = 0;
+
+        for (uint8_t i = 0; i < p->n_params; ++i) {
+                if (i == 0 || !(p->colon & (1u << i))) {
+                        ++f;
+                        s = 0;
+                } else {
+                        ++s;
+                }
+                if (f == field && s == sub)
+                        return p->params[i] ? p->params[i] : def;
+                if (f > field) break;
+        }
+        return def;
+}
+
+/**
+ * @brief Returns the modifier bits encoded by a field (1 + bits, lock keys ignored).
+ * @param field Field index.
+ */
+static uint8_t _kiloc_input_mods(uint8_t field)
+{
+        return (uint8_t)((_kiloc_input_field(field, 0, 1) - 1) & 0x0F);
+}
+
+/**
+ * @brief Returns the kitty event type of a field as enum kiloc_key_action.
+ * @param field Field index.
+ */
+static uint8_t _kiloc_input_action(uint8_t field)
+{
+        uint32_t e = _kiloc_input_field(field, 1, 1);
+        return (e >= 1 && e <= 3) ? (uint8_t)(e - 1) : KILOC_KEY_PRESS;
+}
+
+/**
+ * @brief Switches to the kitty keyboard protocol after the terminal answered
+ * the query sent by kiloc_init.
+ *
+ * Pushes "disambiguate escape codes" and "report event types": every key then
+ * arrives as an unambiguous sequence, so no ESC timeout is needed.
+ */
+static void _kiloc_input_kitty(void)
+{
+        if (k->kitty) return;
+
+        _kiloc_puts("\033[>3u");
+        _kiloc_flush();
+        k->kitty = true;
+        k->caps.kitty_keys = true;
+}
+
+/**
+ * @brief Decodes the final byte of a CSI sequence into a key.
+ * @param final The final byte.
+ */
+static void _kiloc_input_csi(uint8_t final)
+{
+        /* Key for "CSI <n> ~", indexed by n. */
+        static const uint32_t tilde[25] = {
+                [1] = KILOC_KEY_HOME, [2] = KILOC_KEY_INSERT, [3] = KILOC_KEY_DELETE,
+                [4] = KILOC_KEY_END, [5] = KILOC_KEY_PGUP, [6] = KILOC_KEY_PGDN,
+                [7] = KILOC_KEY_HOME, [8] = KILOC_KEY_END,
+                [11] = KILOC_KEY_F1, [12] = KILOC_KEY_F1 + 1, [13] = KILOC_KEY_F1 + 2,
+                [14] = KILOC_KEY_F1 + 3, [15] = KILOC_KEY_F1 + 4, [17] = KILOC_KEY_F1 + 5,
+                [18] = KILOC_KEY_F1 + 6, [19] = KILOC_KEY_F1 + 7, [20] = KILOC_KEY_F1 + 8,
+                [21] = KILOC_KEY_F1 + 9, [23] = KILOC_KEY_F1 + 10, [24] = KILOC_KEY_F1 + 11,
+        };
+        struct kiloc_parser *p = &k->in;
+        uint32_t code = 0;
+        uint32_t n = _kiloc_input_field(0, 0, 1);
+
+        // SGR mouse report: CSI < b ; x ; y M (press) or m (release).
+        if (p->priv == '<' && (final == 'M' || final == 'm')) {
+                if (p->n_params >= 3)
+                        _kiloc_mouse_report(p->params[0], p->params[1], p->params[2], final == 'm');
+                return;
+        }
+
+        // Kitty keyboard protocol supported: CSI ? flags u.
+        if (p->priv == '?' && final == 'u') {
+                if (!k->replay)
+                        _kiloc_input_kitty();
+                return;
+        }
+
+        // Private-marker and intermediate sequences are terminal replies, not keys.
+        if (p->priv || p->inter) {
+                _kiloc_caps_csi(final);
+                return;
+        }
+
+        switch (final) {
+                case 'A': code = KILOC_KEY_UP; break;
+                case 'B': code = KILOC_KEY_DOWN; break;
+                case 'C': code = KILOC_KEY_RIGHT; break;
+                case 'D': code = KILOC_KEY_LEFT; break;
+                case 'H': code = KILOC_KEY_HOME; break;
+                case 'F': code = KILOC_KEY_END; break;
+                case 'P': code = KILOC_KEY_F1; break;
+                case 'Q': code = KILOC_KEY_F1 + 1; break;
+                case 'R': code = KILOC_KEY_F1 + 2; break;
+                case 'S': code = KILOC_KEY_F1 + 3; break;
+                case 'Z':
+                        _kiloc_input_key(KILOC_KEY_TAB, KILOC_MOD_SHIFT);
+                        return;
+                case 'u':
+                        // Kitty: CSI code[:alternates] ; mods[:event] u
+                        code = n;
+                        break;
+                case '~':
+                        if (n == 200) {
+                                p->state = S_PASTE;
+                                p->paste_match = 0;
+                                k->pasting = true;
+                                _kiloc_input_paste_emit(NULL, 0, KILOC_PASTE_BEGIN);
+                                return;
+                        }
+                        if (n < 25)
+                                code = tilde[n];
+                        break;
+        }
+
+        if (code)
+                _kiloc_input_key_ev(code, _kiloc_input_mods(1), _kiloc_input_action(1));
+}
+
+/**
+ * @brief Decodes the final byte of an SS3 sequence into a key.
+ * @param final The final byte.
+ */
+static void _kiloc_input_ss3(uint8_t final)
+{
+        uint8_t mods = _kiloc_input_mods(0);
+
+        switch (final) {
+                case 'A': _kiloc_input_key(KILOC_KEY_UP, mods); break;
+                case 'B': _kiloc_input_key(KILOC_KEY_DOWN, mods); break;
+                case 'C': _kiloc_input_key(KILOC_KEY_RIGHT, mods); break;
+                case 'D': _kiloc_input_key(KILOC_KEY_LEFT, mods); break;
+                case 'H': _kiloc_input_key(KILOC_KEY_HOME, mods); break;
+                case 'F': _kiloc_input_key(KILOC_KEY_END, mods); break;
+                case 'M': _kiloc_input_key(KILOC_KEY_ENTER, mods); break;
+                case 'P': _kiloc_input_key(KILOC_KEY_F1, mods); break;
+                case 'Q': _kiloc_input_key(KILOC_KEY_F1 + 1, mods); break;
+                case 'R': _kiloc_input_key(KILOC_KEY_F1 + 2, mods); break;
+                case 'S': _kiloc_input_key(KILOC_KEY_F1 + 3, mods); break;
+        }
+}
+
+/**
+ * @brief Returns true while the parser waits inside an escape sequence.
+ */
+static bool _kiloc_input_pending(void)
+{
+        // With the kitty protocol a lone ESC is always a sequence prefix.
+        if (k->kitty)
+                return false;
+
+        return k->in.state == S_ESC || k->in.state == S_CSI || k->in.state == S_SS3;
+}
+
+/* API */
+/**
+ * @brief See header for details. Runs the input state machine over a buffer.
+ */
+void kiloc_input_feed(const char *buf, size_t len)
+{
+        struct kiloc_parser *p = &k->in;
+        const uint8_t *b = (const uint8_t *)buf;
+        const uint8_t *end = b + len;
+
+        // Keys read by kiloc_render during the probe come first.
+        if (k->n_held && !k->holding)
+                _kiloc_hold_release();
+
+        _kiloc_rec_input(buf, len);
+
+        // Stamp the input; the earliest unrendered stamp is kept for latency.
+        k->in_ts = _kiloc_now_ns();
+        if (k->lat_pending == 0)
+                k->lat_pending = k->in_ts;
+
+        while (b < end) {
+                if (p->state == S_PASTE) {
+                        b = _kiloc_input_paste(b, end);
+                        continue;
+                }
+
+                // Fast path for runs of printable ASCII (typing).
+                if (p->state == S_GROUND && !p->alt) {
+                        while (b < end && *b >= 0x20 && *b < 0x7F)
+                                _kiloc_input_key(*b++, 0);
+                        if (b == end) break;
+                }
+
+                uint8_t byte = *b;
+                struct _kiloc_trans t = _kiloc_in_trans[p->state][_kiloc_in_class[byte]];
+                p->state = t.next;
+
+                switch (t.act) {
+                        case A_NONE:
+                        case A_BAD:
+                                break;
+                        case A_PRINT:
+                                _kiloc_input_key(byte, 0);
+                                break;
+                        case A_CTRL:
+                                _kiloc_input_ctrl(byte);
+                                break;
+                        case A_DEL:
+                                _kiloc_input_key(KILOC_KEY_BACKSPACE, 0);
+                                break;
+                        case A_ESC:
+                                _kiloc_input_key(KILOC_KEY_ESC, 0);
+                                break;
+                        case A_CSI:
+                                p->priv = p->inter = 0;
+                                p->n_params = 0;
+                                p->colon = 0;
+                                p->params[0] = 0;
+                                break;
+                        case A_DIGIT:
+                                if (p->n_params == 0) p->n_params = 1;
+                                if (p->n_params <= KILOC_MAX_PARAMS)
+                                        p->params[p->n_params - 1] = p->params[p->n_params - 1] * 10 + (byte - '0');
+                                break;
+                        case A_SEP:
+                                if (p->n_params == 0) p->n_params = 1;
+                                if (p->n_params < KILOC_MAX_PARAMS) {
+                                        if (byte == ':') p->colon |= (uint16_t)(1u << p->n_params);
+                                        p->params[p->n_params] = 0;
+                                }
+                                p->n_params++;
+                                break;
+                        case A_PRIV:
+                                p->priv = byte;
+                                break;
+                        case A_INTER:
+                                p->inter = byte;
+                                break;
+                        case A_CSI_END:
+                                if (p->n_params > KILOC_MAX_PARAMS) p->n_params = KILOC_MAX_PARAMS;
+                                _kiloc_input_csi(byte);
+                                break;
+                        case A_SS3_END:
+                                if (p->n_params > KILOC_MAX_PARAMS) p->n_params = KILOC_MAX_PARAMS;
+                                _kiloc_input_ss3(byte);
+                                break;
+                        case A_ALT:
+                                // Reprocess the byte in the ground state with Alt pending.
+                                p->alt = true;
+                                continue;
+                        case A_U2:
+                                p->cp = byte & 0x1F;
+                                p->need = 1;
+                                break;
+                        case A_U3:
+                                p->cp = byte & 0x0F;
+                                p->need = 2;
+                                break;
+                        case A_U4:
+                                p->cp = byte & 0x07;
+                                p->need = 3;
+                                break;
+                        case A_UCONT:
+                                p->cp = (p->cp << 6) | (byte & 0x3F);
+                                if (--p->need == 0) {
+                                        p->state = S_GROUND;
+                                        _kiloc_input_key(p->cp, 0);
+                                }
+                                break;
+                        case A_UBAD:
+                                _kiloc_input_key(0xFFFD, 0);
+                                continue;
+                        case A_DCS:
+                                // Outside the capability probe ESC P is Alt+Shift+P.
+                                if (!k->probing) {
+                                        p->state = S_GROUND;
+                                        p->alt = true;
+                                        continue;
+                                }
+                                p->dcs_len = 0;
+                                break;
+                        case A_DCS_PUT:
+                                // Probe replies start "0+r" or "1+r"; anything else was typed.
+                                if ((p->dcs_len == 0 && byte != '0' && byte != '1')
+                                    || (p->dcs_len == 1 && byte != '+')) {
+                                        p->state = S_GROUND;
+                                        _kiloc_input_key('P', KILOC_MOD_ALT);
+                                        if (p->dcs_len)
+                                                _kiloc_input_key((uint8_t)p->dcs[0], 0);
+                                        continue;
+                                }
+                                if (p->dcs_len < KILOC_MAX_DCS - 1)
+                                        p->dcs[p->dcs_len++] = (char)byte;
+                                break;
+                        case A_DCS_END:
+                                p->dcs[p->dcs_len] = '\0';
+                                _kiloc_caps_dcs();
+                                break;
+                }
+                ++b;
+        }
+}
+
+/**
+ * @brief See header for details. Resolves an unfinished escape sequence.
+ */
+void kiloc_input_flush(void)
+{
+        struct kiloc_parser *p = &k->in;
+
+        // A lone ESC is the Escape key, a lone ESC P is Alt+P; a truncated sequence is dropped.
+        if (p->state == S_ESC)
+                _kiloc_input_key(KILOC_KEY_ESC, 0);
+        else if (p->state == S_DCS && p->dcs_len < 2) {
+                _kiloc_input_key('P', KILOC_MOD_ALT);
+                if (p->dcs_len)
+                        _kiloc_input_key((uint8_t)p->dcs[0], 0);
+        }
+        p->state = S_GROUND;
+        p->alt = false;
+
+        _kiloc_rec_flush();
+        _kiloc_coalesce_flush();
+}
+
+
+/*-------- Mouse APIs --------*/
+/* Static */
+
+/**
+ * @brief Returns the display width in columns of a UTF-8 string.
+ * @param str The string (may be NULL).
+ */
+static uint16_t _kiloc_str_width(const char *str)
+{
+        uint16_t w = 0;
+
+        while (str && *str != '\0') {
+                int len = _kiloc_get_utf8_len(str);
+                if (len == 0) break;
+                w += _kiloc_get_char_width(str, len);
+                str += len;
+        }
+        return w;
+}
+
+/**
+ * @brief Computes a component's rectangle and paints its CID into the hit map,
+ * then recurses so that later (topmost) components overwrite earlier ones.
+ * @param c The component.
+ */
+static void _kiloc_hit_paint(struct kiloc_cmp *c)
+{
+        switch (c->type) {
+                case root:
+                        c->abs_w = k->max_w;
+                        c->abs_h = k->max_h;
+                        break;
+                case container:
+                        c->abs_w = ((struct container *)c->self)->w;
+                        c->abs_h = ((struct container *)c->self)->h;
+                        break;
+                case box:
+                        c->abs_w = ((struct box *)c->self)->w;
+                        c->abs_h = ((struct box *)c->self)->h;
+                        break;
+                case text:
+                        c->abs_w = _kiloc_str_width(((struct text *)c->self)->content);
+                        c->abs_h = 1;
+                        break;
+                case binding:
+                        c->abs_w = _kiloc_str_width(((struct binding *)c->self)->buf);
+                        c->abs_h = 1;
+                        break;
+        }
+
+        if (c->type != root) {
+                uint16_t ex = (c->abs_x + c->abs_w < k->max_w) ? c->abs_x + c->abs_w : k->max_w;
+                uint16_t ey = (c->abs_y + c->abs_h < k->max_h) ? c->abs_y + c->abs_h : k->max_h;
+
+                for (uint16_t y = c->abs_y; y < ey; ++y)
+                        for (uint16_t x = c->abs_x; x < ex; ++x)
+                                k->hit_map[y * k->max_w + x] = c->cid;
+        }
+
+        for (uint16_t i = 0; i < c->child_count; ++i)
+                _kiloc_hit_paint(c->children[i]);
+}
+
+/**
+ * @brief Rebuilds the hit map if a frame was rendered since the last build.
+ * @return False if the map could not be allocated.
+ */
+static bool _kiloc_hit_update(void)
+{
+        if (k->hit_map == NULL) {
+                k->hit_map = (uint16_t *)calloc((size_t)k->max_w * k->max_h, sizeof(uint16_t));
+                if (k->hit_map == NULL) return false;
+                k->hit_stale = true;
+        }
+
+        if (k->hit_stale) {
+                memset(k->hit_map, 0, (size_t)k->max_w * k->max_h * sizeof(uint16_t));
+                _kiloc_hit_paint(&k->root);
+                k->hit_stale = false;
+        }
+        return true;
+}
+
+/**
+ * @brief Turns an SGR mouse report into a hit-tested KILOC_EV_MOUSE event.
+ * @param b The SGR button code.
+ * @param col The 1-based terminal column.
+ * @param row The 1-based terminal row.
+ * @param release True for a release report ('m').
+ */
+static void _kiloc_mouse_report(uint32_t b, uint32_t col, uint32_t row, bool release)
+{
+        struct kiloc_event ev = { .type = KILOC_EV_MOUSE, .ts = k->in_ts };
+        uint16_t left = k->offset_x + (k->bdry ? 1 : 0);
+        uint16_t top = k->offset_y + (k->bdry ? 1 : 0);
+
+        ev.mouse.mods = (uint8_t)(((b & 4) ? KILOC_MOD_SHIFT : 0) | ((b & 8) ? KILOC_MOD_ALT : 0)
+                                  | ((b & 16) ? KILOC_MOD_CTRL : 0));
+        ev.mouse.button = (uint8_t)(b & 3);
+
+        if (b & 64) {
+                ev.mouse.action = KILOC_MOUSE_WHEEL;
+                switch (b & 3) {
+                        case 0: ev.mouse.dy = -1; break;
+                        case 1: ev.mouse.dy = 1; break;
+                        case 2: ev.mouse.dx = -1; break;
+                        case 3: ev.mouse.dx = 1; break;
+                }
+        } else if (b & 32) {
+                ev.mouse.action = KILOC_MOUSE_MOTION;
+        } else {
+                ev.mouse.action = release ? KILOC_MOUSE_RELEASE : KILOC_MOUSE_PRESS;
+        }
+
+        // The screen row of an inline region is not tracked, so rows cannot be mapped.
+        if (k->mode != Inl && col > left && row > top && col - left <= k->max_w && row - top <= k->max_h) {
+                ev.mouse.inside = true;
+                ev.mouse.x = (uint16_t)(col - left - 1);
+                ev.mouse.y = (uint16_t)(row - top - 1);
+                ev.mouse.target = kiloc_hit(ev.mouse.x, ev.mouse.y);
+        }
+
+        _kiloc_emit(&ev);
+}
+
+/* API */
+/**
+ * @brief See header for details. Switches SGR mouse reporting.
+ */
+void kiloc_mouse(bool enable, bool motion)
+{
+        if (enable) {
+                _kiloc_puts(motion ? "\033[?1003h\033[?1006h" : "\033[?1000h\033[?1006h");
+        } else {
+                _kiloc_coalesce_flush();
+                _kiloc_puts("\033[?1003l\033[?1000l\033[?1006l");
+        }
+        _kiloc_flush();
+        k->mouse_on = enable;
+        k->mouse_motion = enable && motion;
+}
+
+/**
+ * @brief See header for details. Hit-tests a canvas position.
+ */
+uint16_t kiloc_hit(uint16_t x, uint16_t y)
+{
+        if (x >= k->max_w || y >= k->max_h || !_kiloc_hit_update())
+                return 0;
+
+        return k->hit_map[y * k->max_w + x];
+}
+
+
+/*-------- Focus APIs --------*/
+/* Static */
+
+/**
+ * @brief Appends the focusable components of a subtree in traversal order.
+ * @param c The subtree root.
+ */
+static void _kiloc_focus_collect(struct kiloc_cmp *c)
+{
+        if (c->focusable) {
+                c->focus_pos = k->n_focus;
+                k->focus_chain[k->n_focus++] = c;
+        }
+
+        for (uint16_t i = 0; i < c->child_count; ++i)
+                _kiloc_focus_collect(c->children[i]);
+}
+
+/**
+ * @brief Rebuilds the focus chain after the tree changed.
+ */
+static void _kiloc_focus_build(void)
+{
+        if (!k->focus_stale) return;
+
+        // The chain never holds more than every component; it is sized once.
+        k->n_focus = 0;
+        if (k->focus_chain == NULL)
+                k->focus_chain = (struct kiloc_cmp **)malloc((k->n_cmp + 1) * sizeof(struct kiloc_cmp *));
+        if (k->focus_chain == NULL) return;
+        _kiloc_focus_collect(&k->root);
+        k->focus_stale = false;
+}
+
+/**
+ * @brief Moves the focus by a step along the chain.
+ * @param step +1 for next, -1 for previous.
+ */
+static void _kiloc_focus_step(int step)
+{
+        _kiloc_focus_build();
+        if (k->n_focus == 0) return;
+
+        struct kiloc_cmp *f = k->focus ? k->cids[k->focus] : NULL;
+        int i = (f && f->focusable) ? (int)f->focus_pos + step : (step > 0 ? 0 : (int)k->n_focus - 1);
+        i = (i + k->n_focus) % k->n_focus;
+        kiloc_focus(k->focus_chain[i]->cid);
+}
+
+/**
+ * @brief Routes input events through the component tree.
+ *
+ * Keys first go through the key bindings of the focus path. Keys and pastes
+ * then go to the focused component, mouse events to the component under the
+ * pointer (a press also focuses it), both bubbling up through parents.
+ * Unhandled Tab and Shift-Tab move the focus.
+ *
+ * @param ev The event.
+ * @return True if the event was consumed.
+ */
+static bool _kiloc_focus_route(const struct kiloc_event *ev)
+{
+        switch (ev->type) {
+                case KILOC_EV_PASTE:
+                        return k->focus && kiloc_dispatch(k->focus, ev);
+                case KILOC_EV_KEY:
+                        if (_kiloc_keys_dispatch(ev))
+                                return true;
+                        if (k->focus && kiloc_dispatch(k->focus, ev))
+                                return true;
+                        if (ev->key.code == KILOC_KEY_TAB && ev->key.action != KILOC_KEY_RELEASE
+                            && (ev->key.mods & ~KILOC_MOD_SHIFT) == 0) {
+                                _kiloc_focus_step((ev->key.mods & KILOC_MOD_SHIFT) ? -1 : 1);
+                                return true;
+                        }
+                        return false;
+                case KILOC_EV_MOUSE:
+                        if (!ev->mouse.inside) return false;
+                        if (ev->mouse.action == KILOC_MOUSE_PRESS) {
+                                struct kiloc_cmp *c = k->cids[ev->mouse.target];
+                                while (c && !c->focusable)
+                                        c = c->parent;
+                                if (c) kiloc_focus(c->cid);
+                        }
+                        return ev->mouse.target && kiloc_dispatch(ev->mouse.target, ev);
+                default:
+                        return false;
+        }
+}
+
+/* API */
+/**
+ * @brief See header for details. Moves the focus.
+ */
+void kiloc_focus(uint16_t cid)
+{
+        if (cid == k->focus) return;
+
+        if (k->focus && k->cids[k->focus])
+                k->cids[k->focus]->focused = false;
+
+        k->focus = cid;
+        if (cid && k->cids[cid])
+                k->cids[cid]->focused = true;
+
+        kiloc_request_frame();
+}
+
+/**
+ * @brief See header for details. Focuses the next component.
+ */
+void kiloc_focus_next(void)
+{
+        _kiloc_focus_step(1);
+}
+
+/**
+ * @brief See header for details. Focuses the previous component.
+ */
+void kiloc_focus_prev(void)
+{
+        _kiloc_focus_step(-1);
+}
+
+/**
+ * @brief See header for details. Returns the focused CID.
+ */
+uint16_t kiloc_focused(void)
+{
+        return k->focus;
+}
+
+/**
+ * @brief See header for details. Bubbles an event from a component to the root.
+ */
+bool kiloc_dispatch(uint16_t cid, const struct kiloc_event *ev)
+{
+        for (struct kiloc_cmp *c = k->cids[cid]; c; c = c->parent)
+                if (c->on_event && c->on_event(c, ev))
+                        return true;
+
+        return false;
+}
+
+
+/*-------- Key binding APIs --------*/
+/* Static */
+
+/**
+ * @brief Packs a key code and modifiers into a trie key.
+ */
+static uint64_t _kiloc_keys_pack(uint32_t code, uint8_t mods)
+{
+        return (uint64_t)code | ((uint64_t)mods << 32);
+}
+
+/**
+ * @brief Hash slot for an edge (from, key) in a table of the given capacity.
+ */
+static uint32_t _kiloc_keys_slot(uint32_t from, uint64_t key, uint32_t cap)
+{
+        uint64_t h = (key ^ ((uint64_t)from << 40) ^ from) * 0x9E3779B97F4A7C15ULL;
+        return (uint32_t)(h >> 32) & (cap - 1);
+}
+
+/**
+ * @brief Looks up the child of a trie node for a key.
+ * @return The child node, or 0 if there is none.
+ */
+static uint32_t _kiloc_keys_child(uint32_t from, uint64_t key)
+{
+        if (k->bedge_cap == 0) return 0;
+
+        for (uint32_t i = _kiloc_keys_slot(from, key, k->bedge_cap); k->bedges[i].from;
+             i = (i + 1) & (k->bedge_cap - 1))
+                if (k->bedges[i].from == from && k->bedges[i].key == key)
+                        return k->bedges[i].to;
+
+        return 0;
+}
+
+/**
+ * @brief Inserts an edge, growing the table to keep it at most half full.
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int _kiloc_keys_link(uint32_t from, uint64_t key, uint32_t to)
+{
+        if ((k->n_bedges + 1) * 2 > k->bedge_cap) {
+                uint32_t cap = k->bedge_cap ? k->bedge_cap * 2 : 64;
+                struct kiloc_bedge *t = (struct kiloc_bedge *)calloc(cap, sizeof(struct kiloc_bedge));
+                if (t == NULL) return -1;
+
+                for (uint32_t i = 0; i < k->bedge_cap; ++i) {
+                        if (!k->bedges[i].from) continue;
+                        uint32_t j = _kiloc_keys_slot(k->bedges[i].from, k->bedges[i].key, cap);
+                        while (t[j].from) j = (j + 1) & (cap - 1);
+                        t[j] = k->bedges[i];
+                }
+                free(k->bedges);
+                k->bedges = t;
+                k->bedge_cap = cap;
+        }
+
+        uint32_t i = _kiloc_keys_slot(from, key, k->bedge_cap);
+        while (k->bedges[i].from) i = (i + 1) & (k->bedge_cap - 1);
+        k->bedges[i].from = from;
+        k->bedges[i].key = key;
+        k->bedges[i].to = to;
+        k->n_bedges++;
+        return 0;
+}
+
+/**
+ * @brief Allocates an empty trie node.
+ * @return The node index, or 0 on allocation failure.
+ */
+static uint32_t _kiloc_keys_node(void)
+{
+        if (k->n_bnodes == 0) k->n_bnodes = 1;  // Node 0 means "none".
+
+        if (k->n_bnodes >= k->bnode_cap) {
+                uint32_t cap = k->bnode_cap ? k->bnode_cap * 2 : 64;
+                struct kiloc_bnode *n = (struct kiloc_bnode *)realloc(k->bnodes, cap * sizeof(struct kiloc_bnode));
+                if (n == NULL) return 0;
+                k->bnodes = n;
+                k->bnode_cap = cap;
+        }
+
+        memset(&k->bnodes[k->n_bnodes], 0, sizeof(struct kiloc_bnode));
+        return k->n_bnodes++;
+}
+
+/**
+ * @brief Parses one key of a chord ("C-x", "Enter", "g", ...).
+ * @param s Start of the key.
+ * @param len Length of the key.
+ * @param out Receives the packed key.
+ * @return True on success.
+ */
+static bool _kiloc_keys_parse_one(const char *s, size_t len, uint64_t *out)
+{
+        static const struct { const char *name; uint32_t code; } names[] = {
+                { "Tab", KILOC_KEY_TAB }, { "Enter", KILOC_KEY_ENTER }, { "Ret", KILOC_KEY_ENTER },
+                { "Esc", KILOC_KEY_ESC }, { "Backspace", KILOC_KEY_BACKSPACE }, { "BS", KILOC_KEY_BACKSPACE },
+                { "Space", ' ' }, { "Up", KILOC_KEY_UP }, { "Down", KILOC_KEY_DOWN },
+                { "Left", KILOC_KEY_LEFT }, { "Right", KILOC_KEY_RIGHT }, { "Home", KILOC_KEY_HOME },
+                { "End", KILOC_KEY_END }, { "Insert", KILOC_KEY_INSERT }, { "Delete", KILOC_KEY_DELETE },
+                { "Del", KILOC_KEY_DELETE }, { "PgUp", KILOC_KEY_PGUP }, { "PgDn", KILOC_KEY_PGDN },
+        };
+        static const struct { const char *prefix; uint8_t mod; } prefixes[] = {
+                { "Ctrl-", KILOC_MOD_CTRL }, { "Alt-", KILOC_MOD_ALT }, { "Shift-", KILOC_MOD_SHIFT },
+                { "Super-", KILOC_MOD_SUPER }, { "C-", KILOC_MOD_CTRL }, { "M-", KILOC_MOD_ALT },
+                { "S-", KILOC_MOD_SHIFT }, { "s-", KILOC_MOD_SUPER },
+        };
+        uint8_t mods = 0;
+        bool more = true;
+
+        // Modifier prefixes; a key name is never followed by '-', so "C--" is Ctrl + '-'.
+        while (more && len > 2) {
+                more = false;
+                for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); ++i) {
+                        size_t pl = strlen(prefixes[i].prefix);
+                        if (len > pl && strncmp(s, prefixes[i].prefix, pl) == 0) {
+                                mods |= prefixes[i].mod;
+                                s += pl;
+                                len -= pl;
+                                more = true;
+                                break;
+                        }
+                }
+        }
+
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+                if (strlen(names[i].name) == len && strncmp(s, names[i].name, len) == 0) {
+                        *out = _kiloc_keys_pack(names[i].code, mods);
+                        return true;
+                }
+        }
+
+        if (len >= 2 && len <= 3 && s[0] == 'F' && s[1] >= '1' && s[1] <= '9') {
+                int n = atoi(s + 1);
+                if (n >= 1 && n <= 12) {
+                        *out = _kiloc_keys_pack(KILOC_KEY_F1 + n - 1, mods);
+                        return true;
+                }
+        }
+
+        // A single UTF-8 character.
+        wchar_t wc;
+        if ((size_t)_kiloc_get_utf8_len(s) == len && mbtowc(&wc, s, len) == (int)len) {
+                *out = _kiloc_keys_pack((uint32_t)wc, mods);
+                return true;
+        }
+
+        return false;
+}
+
+/**
+ * @brief Returns the innermost scope of the focus path.
+ */
+static struct kiloc_cmp *_kiloc_keys_path(void)
+{
+        return (k->focus && k->cids[k->focus]) ? k->cids[k->focus] : &k->root;
+}
+
+/**
+ * @brief Steps a scope's trie from where the pending chord left it.
+ * @param scope The scope CID.
+ * @param key The new key.
+ * @return The reached node, or 0 if the sequence is not bound in this scope.
+ */
+static uint32_t _kiloc_keys_next(uint16_t scope, uint64_t key)
+{
+        uint32_t node = k->chord_n ? k->chord_node[scope] : k->scope_root[scope];
+
+        return node ? _kiloc_keys_child(node, key) : 0;
+}
+
+/**
+ * @brief Forgets the pending chord and its timeout.
+ */
+static void _kiloc_keys_reset(void)
+{
+        k->chord_n = 0;
+        if (k->chord_timer >= 0) {
+                kiloc_del_timer(k->chord_timer);
+                k->chord_timer = -1;
+        }
+}
+
+/**
+ * @brief Ends the pending chord, running its own binding if it has one
+ * (e.g. "g" when "g g" was also bound but never completed).
+ * @return True if a binding ran.
+ */
+static bool _kiloc_keys_finish(void)
+{
+        if (k->chord_n == 0) return false;
+
+        for (struct kiloc_cmp *c = _kiloc_keys_path(); c; c = c->parent) {
+                uint32_t node = k->chord_node[c->cid];
+                if (node && k->bnodes[node].cb) {
+                        _kiloc_keys_reset();
+                        k->bnodes[node].cb(c->cid, k->bnodes[node].ud);
+                        return true;
+                }
+        }
+        _kiloc_keys_reset();
+        return false;
+}
+
+/**
+ * @brief Chord timeout: finishes the pending chord.
+ */
+static void _kiloc_keys_expired(int id, void *ud)
+{
+        (void)ud;
+        if (k->chord_timer == id)
+                k->chord_timer = -1;
+        _kiloc_keys_finish();
+}
+
+/**
+ * @brief Steps the pending chord with a key across the scopes of the focus path.
+ * @param key The packed key.
+ * @return True if the key completed or extended a chord.
+ */
+static bool _kiloc_keys_step(uint64_t key)
+{
+        bool prefix = false;
+
+        for (struct kiloc_cmp *c = _kiloc_keys_path(); c; c = c->parent) {
+                uint32_t node = _kiloc_keys_next(c->cid, key);
+                if (!node) continue;
+
+                // A complete chord fires unless an inner scope is still extending it.
+                if (k->bnodes[node].n_children == 0 && k->bnodes[node].cb && !prefix) {
+                        _kiloc_keys_reset();
+                        k->bnodes[node].cb(c->cid, k->bnodes[node].ud);
+                        return true;
+                }
+                if (k->bnodes[node].n_children)
+                        prefix = true;
+        }
+
+        if (!prefix || k->chord_n >= KILOC_MAX_CHORD) return false;
+
+        // Advance every scope of the path; the pass above must not, as a broken
+        // chord still needs the nodes it reached.
+        for (struct kiloc_cmp *c = _kiloc_keys_path(); c; c = c->parent)
+                k->chord_node[c->cid] = _kiloc_keys_next(c->cid, key);
+        if (k->chord_n++ == 0)
+                k->chord_focus = k->focus;
+
+        if (k->chord_timer >= 0)
+                kiloc_del_timer(k->chord_timer);
+        k->chord_timer = kiloc_add_timer(k->chord_ms, false, _kiloc_keys_expired, NULL);
+        return true;
+}
+
+/**
+ * @brief Runs key bindings for a key event.
+ * @param ev The key event.
+ * @return True if the key was consumed by a binding or a pending chord.
+ */
+static bool _kiloc_keys_dispatch(const struct kiloc_event *ev)
+{
+        if (k->n_bedges == 0 || ev->key.action == KILOC_KEY_RELEASE)
+                return false;
+
+        uint64_t key = _kiloc_keys_pack(ev->key.code, ev->key.mods);
+
+        // The nodes of a pending chord belong to the focus path it started on.
+        if (k->chord_n > 0 && k->chord_focus != k->focus)
+                _kiloc_keys_reset();
+
+        if (_kiloc_keys_step(key))
+                return true;
+
+        // A broken chord runs its own binding, then the key is tried on its own.
+        if (k->chord_n > 0) {
+                _kiloc_keys_finish();
+                return _kiloc_keys_step(key);
+        }
+
+        return false;
+}
+
+
+/* API */
+/**
+ * @brief See header for details. Compiles a chord into the scope's trie.
+ */
+int kiloc_bind_key(uint16_t scope, const char *chord, void (*cb)(uint16_t scope, void *ud), void *ud)
+{
+        uint64_t keys[KILOC_MAX_CHORD];
+        int n = 0;
+        const char *p = chord;
+
+        if (chord == NULL || scope >= k->n_cmp) return -1;
+
+        while (*p) {
+                while (*p == ' ') ++p;
+                if (*p == '\0') break;
+
+                const char *e = p;
+                while (*e && *e != ' ') ++e;
+                if (n == KILOC_MAX_CHORD || !_kiloc_keys_parse_one(p, (size_t)(e - p), &keys[n]))
+                        return -1;
+                ++n;
+                p = e;
+        }
+        if (n == 0) return -1;
+
+        if (k->scope_root == NULL) {
+                k->scope_root = (uint32_t *)calloc(k->n_cmp, sizeof(uint32_t));
+                k->chord_node = (uint32_t *)calloc(k->n_cmp, sizeof(uint32_t));
+                if (k->scope_root == NULL || k->chord_node == NULL) {
+                        free(k->scope_root);
+                        free(k->chord_node);
+                        k->scope_root = k->chord_node = NULL;
+                        return -1;
+                }
+        }
+        if (k->scope_root[scope] == 0 && (k->scope_root[scope] = _kiloc_keys_node()) == 0)
+                return -1;
+
+        uint32_t node = k->scope_root[scope];
+        for (int i = 0; i < n; ++i) {
+                uint32_t next = _kiloc_keys_child(node, keys[i]);
+                if (next == 0) {
+                        if ((next = _kiloc_keys_node()) == 0 || _kiloc_keys_link(node, keys[i], next) == -1)
+                                return -1;
+                        k->bnodes[node].n_children++;
+                }
+                node = next;
+        }
+
+        k->bnodes[node].cb = cb;
+        k->bnodes[node].ud = ud;
+        return 0;
+}
+
+
+/*-------- Latency APIs --------*/
+/* Static */
+
+/**
+ * @brief Maps a duration to its histogram bucket (4 buckets per power of two).
+ */
+static uint32_t _kiloc_hist_bucket(uint64_t v)
+{
+        if (v < 4) return (uint32_t)v;
+
+        uint32_t log = 63 - (uint32_t)__builtin_clzll(v);
+        uint32_t b = (log << 2) | (uint32_t)((v >> (log - 2)) & 3);
+        return b < KILOC_HIST_BUCKETS ? b : KILOC_HIST_BUCKETS - 1;
+}
+
+/**
+ * @brief Returns the upper bound of a histogram bucket.
+ */
+static uint64_t _kiloc_hist_upper(uint32_t b)
+{
+        if (b < 4) return b;
+
+        uint32_t log = b >> 2;
+        return ((4ULL | (b & 3)) + 1) << (log - 2);
+}
+
+/**
+ * @brief Adds a sample to a histogram.
+ */
+static void _kiloc_hist_add(struct kiloc_hist *h, uint64_t v)
+{
+        h->buckets[_kiloc_hist_bucket(v)]++;
+        h->count++;
+        if (v > h->max) h->max = v;
+}
+
+/**
+ * @brief Returns a percentile of a histogram (bucket upper bound, capped at max).
+ * @param h The histogram.
+ * @param pct Percentile in [0, 100].
+ */
+static uint64_t _kiloc_hist_pct(const struct kiloc_hist *h, double pct)
+{
+        if (h->count == 0) return 0;
+
+        uint64_t rank = (uint64_t)(pct / 100.0 * (double)h->count + 0.5);
+        uint64_t seen = 0;
+
+        if (rank == 0) rank = 1;
+        for (uint32_t b = 0; b < KILOC_HIST_BUCKETS; ++b) {
+                seen += h->buckets[b];
+                if (seen >= rank) {
+                        uint64_t v = _kiloc_hist_upper(b);
+                        return v < h->max ? v : h->max;
+                }
+        }
+        return h->max;
+}
+
+/**
+ * @brief Records the latency of the input that the frame just written reflects.
+ */
+static void _kiloc_lat_frame(void)
+{
+        if (k->lat_pending == 0) return;
+
+        _kiloc_hist_add(&k->lat, _kiloc_now_ns() - k->lat_pending);
+        k->lat_pending = 0;
+}
+
+/**
+ * @brief Draws the latency percentiles into the top-right corner of the back buffer.
+ */
+static void _kiloc_lat_overlay(void)
+{
+        char line[64];
+        int n = snprintf(line, sizeof(line), " in->out p50 %.2fms p99 %.2fms max %.2fms ",
+                         _kiloc_hist_pct(&k->lat, 50) / 1e6, _kiloc_hist_pct(&k->lat, 99) / 1e6,
+                         k->lat.max / 1e6);
+
+        if (n > 0 && n <= k->max_w)
+                kiloc_putstr(k->max_w - n, 0, line, kiloc_make_style(0xFFFFFF, 0x303030, false, false, false));
+}
+
+/* API */
+/**
+ * @brief See header for details. Summarizes the latency histogram.
+ */
+void kiloc_latency(struct kiloc_latency *out)
+{
+        out->count = k->lat.count;
+        out->p50_ns = _kiloc_hist_pct(&k->lat, 50);
+        out->p99_ns = _kiloc_hist_pct(&k->lat, 99);
+        out->max_ns = k->lat.max;
+}
+
+/**
+ * @brief See header for details. Clears the latency histogram.
+ */
+void kiloc_latency_reset(void)
+{
+        memset(&k->lat, 0, sizeof(k->lat));
+        k->lat_pending = 0;
+}
+
+
+/*-------- Frame timing APIs --------*/
+/* Static */
+
+/**
+ * @brief Returns the time since *lap and restarts it.
+ */
+static uint64_t _kiloc_ft_lap(uint64_t *lap)
+{
+        uint64_t now = _kiloc_now_ns();
+        uint64_t d = now - *lap;
+
+        *lap = now;
+        return d;
+}
+
+/**
+ * @brief Records a timed frame, starting a new half of the window when the current one is full.
+ * @param ph Phase durations, indexed by enum kiloc_phase.
+ * @param start Start time of the frame.
+ * @param bytes Bytes the frame wrote.
+ * @param cells Cells the frame changed.
+ */
+static void _kiloc_ft_frame(const uint64_t *ph, uint64_t start, uint64_t bytes, uint32_t cells)
+{
+        struct kiloc_ft_half *h = &k->ft[k->ft_cur];
+
+        if (h->ph[KILOC_PH_FRAME].count >= KILOC_FT_WINDOW) {
+                k->ft_cur ^= 1;
+                h = &k->ft[k->ft_cur];
+                memset(h, 0, sizeof(*h));
+        }
+        if (h->ph[KILOC_PH_FRAME].count == 0)
+                h->first_ns = start;
+        h->last_ns = start;
+
+        for (int i = 0; i < KILOC_PH_COUNT; ++i) {
+                _kiloc_hist_add(&h->ph[i], ph[i]);
+                k->ft_last[i] = ph[i];
+        }
+        h->bytes += bytes;
+        h->cells += cells;
+        k->ft_last_bytes = bytes;
+        k->ft_last_cells = cells;
+}
+
+/**
+ * @brief Draws FPS, frame time, bytes and changed cells of the last frame into
+ * the bottom-right corner of the back buffer.
+ */
+static void _kiloc_ft_overlay(void)
+{
+        struct kiloc_frame_stats st;
+        char line[80];
+
+        kiloc_frame_stats(&st);
+        int n = snprintf(line, sizeof(line), " %.1ffps %.2fms %lluB %ucells ",
+                         st.fps, st.phase[KILOC_PH_FRAME].last_ns / 1e6,
+                         (unsigned long long)st.last_bytes, st.last_cells);
+
+        if (n > 0 && n <= k->max_w && k->max_h > 0)
+                kiloc_putstr(k->max_w - n, k->max_h - 1, line, kiloc_make_style(0xFFFFFF, 0x303030, false, false, false));
+}
+
+/* API */
+/**
+ * @brief See header for details. Merges both halves of the window.
+ */
+void kiloc_frame_stats(struct kiloc_frame_stats *out)
+{
+        const struct kiloc_ft_half *a = &k->ft[k->ft_cur], *b = &k->ft[k->ft_cur ^ 1];
+        struct kiloc_hist h;
+
+        memset(out, 0, sizeof(*out));
+        for (int i = 0; i < KILOC_PH_COUNT; ++i) {
+                for (uint32_t j = 0; j < KILOC_HIST_BUCKETS; ++j)
+                        h.buckets[j] = a->ph[i].buckets[j] + b->ph[i].buckets[j];
+                h.count = a->ph[i].count + b->ph[i].count;
+                h.max = a->ph[i].max > b->ph[i].max ? a->ph[i].max : b->ph[i].max;
+
+                out->phase[i].last_ns = k->ft_last[i];
+                out->phase[i].p50_ns = _kiloc_hist_pct(&h, 50);
+                out->phase[i].p99_ns = _kiloc_hist_pct(&h, 99);
+                out->phase[i].max_ns = h.max;
+        }
+
+        out->frames = a->ph[KILOC_PH_FRAME].count + b->ph[KILOC_PH_FRAME].count;
+        out->last_bytes = k->ft_last_bytes;
+        out->last_cells = k->ft_last_cells;
+        if (out->frames == 0) return;
+
+        // Frame starts are frames - 1 intervals apart.
+        uint64_t first = b->ph[KILOC_PH_FRAME].count ? b->first_ns : a->first_ns;
+        if (a->last_ns > first)
+                out->fps = (double)(out->frames - 1) * 1e9 / (double)(a->last_ns - first);
+        out->avg_bytes = (double)(a->bytes + b->bytes) / (double)out->frames;
+        out->avg_cells = (double)(a->cells + b->cells) / (double)out->frames;
+}
+
+/**
+ * @brief See header for details.
+ */
+void kiloc_frame_stats_reset(void)
+{
+        memset(k->ft, 0, sizeof(k->ft));
+        memset(k->ft_last, 0, sizeof(k->ft_last));
+        k->ft_cur = 0;
+        k->ft_last_bytes = 0;
+        k->ft_last_cells = 0;
+}
+
+
+/*-------- Profiling APIs --------*/
+/* Static */
+
+/**
+ * @brief Prepares the profile for a frame (allocating it on first use) and
+ * marks the component tree render as profiled.
+ */
+static void _kiloc_prof_begin(void)
+{
+        size_t n = (size_t)k->max_w * k->max_h;
+
+        if (k->prof == NULL)
+                k->prof = (struct kiloc_cmp_prof *)calloc(k->n_cmp, sizeof(*k->prof));
+        if (k->prof_cells == NULL)
+                k->prof_cells = (struct kiloc_prof_cell *)malloc(n * sizeof(*k->prof_cells));
+        if (k->prof == NULL || k->prof_cells == NULL) return;
+
+        memset(k->prof_cells, 0, n * sizeof(*k->prof_cells));
+        for (uint16_t i = 0; i < k->n_cmp; ++i) {
+                k->prof[i].cid = i;
+                k->prof[i].last_ns = 0;
+                k->prof[i].last_cells = 0;
+                k->prof[i].last_overdraw = 0;
+        }
+        k->prof_active = true;
+}
+
+/**
+ * @brief Renders a component, charging it with its time (less its children's)
+ * and the cells it writes.
+ * @param c The component.
+ */
+static void _kiloc_prof_cmp(struct kiloc_cmp *c)
+{
+        struct kiloc_cmp_prof *p = &k->prof[c->cid];
+        uint16_t parent = k->prof_cid;
+        uint64_t siblings = k->prof_child;
+        uint64_t t = _kiloc_now_ns();
+
+        k->prof_cid = c->cid;
+        k->prof_child = 0;
+        _kiloc_cmp_draw(c);
+        t = _kiloc_now_ns() - t;
+
+        p->last_ns += t - k->prof_child;
+        p->total_ns += t - k->prof_child;
+        p->frames++;
+
+        // The parent's own time excludes this subtree.
+        k->prof_cid = parent;
+        k->prof_child = siblings + t;
+}
+
+/**
+ * @brief Counts a cell written by the component being rendered, and the
+ * overdraw of the component that wrote it before.
+ */
+static void _kiloc_prof_cell(uint16_t x, uint16_t y)
+{
+        struct kiloc_prof_cell *pc = &k->prof_cells[(size_t)y * k->max_w + x];
+        struct kiloc_cmp_prof *p = &k->prof[k->prof_cid];
+
+        if (pc->cid != k->prof_cid) {
+                if (pc->cid != 0) {
+                        k->prof[pc->cid].last_overdraw++;
+                        k->prof[pc->cid].total_overdraw++;
+                }
+                if (pc->writes < UINT8_MAX) pc->writes++;
+                pc->cid = k->prof_cid;
+        }
+        p->last_cells++;
+        p->total_cells++;
+}
+
+/**
+ * @brief Tints the background of cells written by several components: amber
+ * for 2, orange for 3, red for 4 or more.
+ */
+static void _kiloc_prof_overlay(void)
+{
+        static const uint32_t tint[] = { 0x806000, 0xA04000, 0xC00000 };
+
+        for (uint16_t y = 0; y < k->max_h; ++y) {
+                const struct kiloc_prof_cell *pc = &k->prof_cells[(size_t)y * k->max_w];
+
+                for (uint16_t x = 0; x < k->max_w; ++x) {
+                        if (pc[x].writes < 2) continue;
+
+                        struct kiloc_cell *b = &k->b_buffer[y][x];
+                        uint32_t bg = tint[pc[x].writes > 4 ? 2 : pc[x].writes - 2];
+                        b->style = (b->style & ~(0xFFFFFFULL << 16)) | ((uint64_t)bg << 16);
+                }
+        }
+}
+
+/**
+ * @brief Returns the total a profile is ordered by.
+ */
+static uint64_t _kiloc_prof_key(const struct kiloc_cmp_prof *p, enum kiloc_prof_key key)
+{
+        switch (key) {
+                case KILOC_PROF_CELLS:
+                        return p->total_cells;
+                case KILOC_PROF_OVERDRAW:
+                        return p->total_overdraw;
+                default:
+                        return p->total_ns;
+        }
+}
+
+/* API */
+/**
+ * @brief See header for details. Keeps out sorted while scanning every profiled component.
+ */
+int kiloc_cmp_prof_top(enum kiloc_prof_key key, struct kiloc_cmp_prof *out, int n)
+{
+        int m = 0;
+
+        if (k->prof == NULL) return 0;
+
+        for (uint16_t i = 1; i < k->n_cmp; ++i) {
+                const struct kiloc_cmp_prof *p = &k->prof[i];
+                uint64_t v = _kiloc_prof_key(p, key);
+                int j = m;
+
+                if (p->frames == 0) continue;
+                while (j > 0 && _kiloc_prof_key(&out[j - 1], key) < v) --j;
+                if (j >= n) continue;
+
+                // Insert at j, dropping the last entry when out is full.
+                if (m < n) ++m;
+                memmove(&out[j + 1], &out[j], (size_t)(m - 1 - j) * sizeof(*out));
+                out[j] = *p;
+        }
+        return m;
+}
+
+/**
+ * @brief See header for details.
+ */
+void kiloc_cmp_prof_reset(void)
+{
+        if (k->prof)
+                memset(k->prof, 0, k->n_cmp * sizeof(*k->prof));
+}
+
+
+/*-------- Coalescing APIs --------*/
+/* Static */
+
+/**
+ * @brief Returns the coalescing kind of an event, or KILOC_CO_COUNT if the
+ * event is never coalesced.
+ */
+static int _kiloc_coalesce_kind(const struct kiloc_event *ev)
+{
+        if (ev->type == KILOC_EV_RESIZE)
+                return KILOC_CO_RESIZE;
+        if (ev->type == KILOC_EV_MOUSE && ev->mouse.action == KILOC_MOUSE_MOTION)
+                return KILOC_CO_MOTION;
+        if (ev->type == KILOC_EV_MOUSE && ev->mouse.action == KILOC_MOUSE_WHEEL)
+                return KILOC_CO_WHEEL;
+        return KILOC_CO_COUNT;
+}
+
+/**
+ * @brief Adds two wheel deltas, saturating at the int16_t range.
+ */
+static int16_t _kiloc_coalesce_sum(int16_t a, int16_t b)
+{
+        int32_t v = (int32_t)a + b;
+
+        return (int16_t)(v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v);
+}
+
+/**
+ * @brief Tells whether a pending event stands for the same slot as a new one.
+ *
+ * Resize has a single slot, motion one per target, and wheel one per target
+ * and modifiers.
+ */
+static bool _kiloc_coalesce_same(const struct kiloc_event *q, const struct kiloc_event *ev, int kind)
+{
+        if (_kiloc_coalesce_kind(q) != kind)
+                return false;
+        if (kind != KILOC_CO_RESIZE && q->mouse.target != ev->mouse.target)
+                return false;
+        return kind != KILOC_CO_WHEEL || q->mouse.mods == ev->mouse.mods;
+}
+
+/**
+ * @brief Queues or merges a coalescable event.
+ *
+ * A pending event of the same slot absorbs the new one and moves to the tail.
+ * Resize and motion keep the last event, and wheel sums the deltas.
+ *
+ * @param ev The event.
+ * @return True if the event was queued or merged (not delivered yet).
+ */
+static bool _kiloc_coalesce_add(const struct kiloc_event *ev)
+{
+        int kind = _kiloc_coalesce_kind(ev);
+        uint8_t i;
+
+        if (kind == KILOC_CO_COUNT || !k->co_on[kind])
+                return false;
+
+        k->co_stats.seen[kind]++;
+
+        for (i = 0; i < k->n_co; ++i)
+                if (_kiloc_coalesce_same(&k->co[i], ev, kind))
+                        break;
+
+        if (i < k->n_co) {
+                struct kiloc_event m = *ev;
+
+                if (kind == KILOC_CO_WHEEL) {
+                        m.mouse.dx = _kiloc_coalesce_sum(k->co[i].mouse.dx, ev->mouse.dx);
+                        m.mouse.dy = _kiloc_coalesce_sum(k->co[i].mouse.dy, ev->mouse.dy);
+                }
+                memmove(&k->co[i], &k->co[i + 1], (size_t)(k->n_co - i - 1) * sizeof(m));
+                k->co[k->n_co - 1] = m;
+                k->co_stats.merged[kind]++;
+                return true;
+        }
+
+        if (k->n_co == KILOC_CO_SLOTS)
+                _kiloc_coalesce_flush();
+
+        k->co[k->n_co++] = *ev;
+        return true;
+}
+
+/**
+ * @brief Delivers all coalesced events in arrival order.
+ */
+static void _kiloc_coalesce_flush(void)
+{
+        uint8_t n = k->n_co;
+
+        // Handlers may emit new events; detach the queue first.
+        k->n_co = 0;
+        for (uint8_t i = 0; i < n; ++i) {
+                struct kiloc_event ev = k->co[i];
+                _kiloc_deliver(&ev);
+        }
+}
+
+/* API */
+/**
+ * @brief See header for details. Switches coalescing for a kind.
+ */
+void kiloc_coalesce(enum kiloc_coalesce_kind kind, bool enable)
+{
+        if (kind >= KILOC_CO_COUNT) return;
+
+        if (!enable)
+                _kiloc_coalesce_flush();
+        k->co_on[kind] = enable;
+}
+
+/**
+ * @brief See header for details. Copies the coalescing counters.
+ */
+void kiloc_coalesce_stats(struct kiloc_coalesce_stats *out)
+{
+        *out = k->co_stats;
+}
+
+
+/*-------- Record and replay APIs --------*/
+/*
+ * Recording format: the magic "KLCREC2\n", then records of
+ *   varint  microseconds since the previous record
+ *   byte    REC_INPUT, REC_RESIZE, REC_FLUSH or REC_FRAME
+ *   REC_INPUT:  varint length, raw bytes
+ *   REC_RESIZE: varint width, varint height
+ *   REC_FLUSH:  kiloc_input_flush ran (e.g. the ESC timeout)
+ *   REC_FRAME:  kiloc_run rendered a frame
+ */
+#define REC_MAGIC       "KLCREC2\n"
+#define REC_MAGIC_LEN   8
+#define REC_INPUT       0
+#define REC_RESIZE      1
+#define REC_FLUSH       2
+#define REC_FRAME       3
+
+/* Static */
+
+/**
+ * @brief Writes an unsigned LEB128 varint to the recording.
+ */
+static void _kiloc_rec_varint(uint64_t v)
+{
+        while (v >= 0x80) {
+                fputc((int)(v & 0x7F) | 0x80, k->rec);
+                v >>= 7;
+        }
+        fputc((int)v, k->rec);
+}
+
+/**
+ * @brief Writes a record header (time delta and type).
+ */
+static void _kiloc_rec_header(uint8_t type)
+{
+        uint64_t now = _kiloc_now_ns();
+
+        _kiloc_rec_varint((now - k->rec_last) / 1000);
+        k->rec_last = now;
+        fputc(type, k->rec);
+}
+
+/**
+ * @brief Records raw input bytes, if recording.
+ */
+static void _kiloc_rec_input(const char *buf, size_t len)
+{
+        if (k->rec == NULL || len == 0) return;
+
+        _kiloc_rec_header(REC_INPUT);
+        _kiloc_rec_varint(len);
+        fwrite(buf, 1, len, k->rec);
+}
+
+/**
+ * @brief Records an input flush, if recording.
+ */
+static void _kiloc_rec_flush(void)
+{
+        if (k->rec == NULL) return;
+
+        _kiloc_rec_header(REC_FLUSH);
+}
+
+/**
+ * @brief Records a frame rendered by kiloc_run, if recording.
+ */
+static void _kiloc_rec_frame(void)
+{
+        if (k->rec == NULL) return;
+
+        _kiloc_rec_header(REC_FRAME);
+}
+
+/**
+ * @brief Records a terminal resize, if recording.
+ */
+static void _kiloc_rec_resize(uint16_t w, uint16_t h)
+{
+        if (k->rec == NULL) return;
+
+        _kiloc_rec_header(REC_RESIZE);
+        _kiloc_rec_varint(w);
+        _kiloc_rec_varint(h);
+}
+
+/**
+ * @brief Reads a varint from the replay buffer.
+ * @return False if the buffer ended.
+ */
+static bool _kiloc_replay_varint(uint64_t *v)
+{
+        *v = 0;
+        for (int shift = 0; k->replay_pos < k->replay_len && shift < 64; shift += 7) {
+                uint8_t b = (uint8_t)k->replay[k->replay_pos++];
+                *v |= (uint64_t)(b & 0x7F) << shift;
+                if (!(b & 0x80)) return true;
+        }
+        return false;
+}
+
+/**
+ * @brief Ends a replay: releases the recording and stops the event loop.
+ */
+static void _kiloc_replay_end(void)
+{
+        free(k->replay);
+        k->replay = NULL;
+        if (k->replay_fd >= 0) {
+                close(k->replay_fd);
+                k->replay_fd = -1;
+        }
+        kiloc_quit();
+}
+
+/**
+ * @brief Arms the replay timer for the next record.
+ */
+static void _kiloc_replay_arm(void)
+{
+        uint64_t us;
+        size_t pos = k->replay_pos;
+
+        // At the end, _kiloc_replay_step ends the replay on the next tick (by
+        // then kiloc_run is running, so its kiloc_quit is not lost).
+        if (!_kiloc_replay_varint(&us))
+                us = 0;
+        k->replay_pos = pos;    // The delay is consumed again by _kiloc_replay_step.
+
+        _kiloc_arm(k->replay_fd, k->replay_realtime && us ? us * 1000ULL : 1, 0);
+}
+
+/**
+ * @brief Applies the next record through the same paths as live input.
+ */
+static void _kiloc_replay_step(void)
+{
+        uint64_t us, a, b;
+
+        if (k->replay == NULL) return;
+        if (!_kiloc_replay_varint(&us) || k->replay_pos >= k->replay_len) {
+                _kiloc_replay_end();
+                return;
+        }
+
+        switch (k->replay[k->replay_pos++]) {
+                case REC_INPUT:
+                        if (!_kiloc_replay_varint(&a) || a > k->replay_len - k->replay_pos) {
+                                _kiloc_replay_end();
+                                return;
+                        }
+                        kiloc_input_feed(k->replay + k->replay_pos, (size_t)a);
+                        k->replay_pos += (size_t)a;
+                        break;
+                case REC_RESIZE:
+                        if (!_kiloc_replay_varint(&a) || !_kiloc_replay_varint(&b)) {
+                                _kiloc_replay_end();
+                                return;
+                        }
+                        _kiloc_set_tersize((uint16_t)a, (uint16_t)b);
+                        break;
+                case REC_FLUSH:
+                        kiloc_input_flush();
+                        break;
+                case REC_FRAME:
+                        _kiloc_loop_frame();
+                        break;
+                default:
+                        _kiloc_replay_end();
+                        return;
+        }
+
+        _kiloc_replay_arm();
+}
+
+/* API */
+/**
+ * @brief See header for details. Opens a recording file.
+ */
+int kiloc_record_start(const char *path)
+{
+        kiloc_record_stop();
+
+        k->rec = fopen(path, "wb");
+        if (k->rec == NULL) return -1;
+
+        fwrite(REC_MAGIC, 1, REC_MAGIC_LEN, k->rec);
+        k->rec_last = _kiloc_now_ns();
+
+        // Start with the current size so replays begin from the same geometry.
+        if (k->ter_w && k->ter_h)
+                _kiloc_rec_resize(k->ter_w, k->ter_h);
+        return 0;
+}
+
+/**
+ * @brief See header for details. Closes the recording file.
+ */
+void kiloc_record_stop(void)
+{
+        if (k->rec == NULL) return;
+
+        fclose(k->rec);
+        k->rec = NULL;
+}
+
+/**
+ * @brief See header for details. Loads a recording for kiloc_run to replay.
+ */
+int kiloc_replay(const char *path, bool realtime)
+{
+        FILE *f = fopen(path, "rb");
+        char magic[REC_MAGIC_LEN];
+        long size;
+
+        if (f == NULL) return -1;
+        if (fread(magic, 1, REC_MAGIC_LEN, f) != REC_MAGIC_LEN || memcmp(magic, REC_MAGIC, REC_MAGIC_LEN) != 0
+            || fseek(f, 0, SEEK_END) == -1 || (size = ftell(f)) < REC_MAGIC_LEN) {
+                fclose(f);
+                errno = EINVAL;
+                return -1;
+        }
+
+        free(k->replay);
+        k->replay_len = (size_t)size - REC_MAGIC_LEN;
+        k->replay = (char *)malloc(k->replay_len ? k->replay_len : 1);
+        if (k->replay == NULL || fseek(f, REC_MAGIC_LEN, SEEK_SET) == -1
+            || fread(k->replay, 1, k->replay_len, f) != k->replay_len) {
+                fclose(f);
+                free(k->replay);
+                k->replay = NULL;
+                return -1;
+        }
+        fclose(f);
+
+        if (_kiloc_loop_setup() == -1) return -1;
+        if (k->replay_fd < 0) {
+                k->replay_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+                if (k->replay_fd == -1 || _kiloc_ep_add(k->replay_fd, EPOLLIN, EP_TAG(EP_REPLAY, 0)) == -1)
+                        return -1;
+        }
+
+        k->replay_pos = 0;
+        k->replay_realtime = realtime;
+        _kiloc_replay_arm();
+        return 0;
+}
+
+
+/*-------- Capability APIs --------*/
+/* Static */
+
+/* How long the probe may take before missing replies count as "unsupported". */
+#define KILOC_PROBE_MS 200
+
+/* XTGETTCAP query for RGB, Tc, rep and ech (names are hex-encoded). */
+#define CAPS_XTGETTCAP "\033P+q524742;5463;726570;656368\033\\"
+
+/**
+ * @brief Builds the cache file path for the current terminal.
+ *
+ * TERM alone is shared by many emulators, so TERM_PROGRAM is part of the key.
+ *
+ * @param buf Receives the path.
+ * @param size Size of buf.
+ * @return true if a path could be built.
+ */
+static bool _kiloc_caps_path(char *buf, size_t size)
+{
+        const char *term = getenv("TERM");
+        const char *prog = getenv("TERM_PROGRAM");
+        const char *xdg = getenv("XDG_CACHE_HOME");
+        const char *home = getenv("HOME");
+        char name[128];
+        int n;
+
+        if (term == NULL || *term == '\0') return false;
+
+        n = snprintf(name, sizeof(name), "caps-%s%s%s", term, prog ? "-" : "", prog ? prog : "");
+        if (n < 0 || (size_t)n >= sizeof(name)) return false;
+        for (char *c = name; *c != '\0'; ++c)
+                if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9')
+                      || *c == '-' || *c == '.'))
+                        *c = '_';
+
+        if (xdg && *xdg == '/')
+                n = snprintf(buf, size, "%s/kiloc/%s", xdg, name);
+        else if (home && *home != '\0')
+                n = snprintf(buf, size, "%s/.cache/kiloc/%s", home, name);
+        else
+                return false;
+        return n > 0 && (size_t)n < size;
+}
+
+/**
+ * @brief Loads a cached profile for the current terminal.
+ * @return true if one was found.
+ */
+static bool _kiloc_caps_load(void)
+{
+        struct kiloc_caps c = { .kitty_keys = k->caps.kitty_keys, .probed = true };
+        char path[512], line[64];
+        unsigned a, b;
+        FILE *f;
+
+        if (!_kiloc_caps_path(path, sizeof(path)) || (f = fopen(path, "r")) == NULL)
+                return false;
+
+        while (fgets(line, sizeof(line), f)) {
+                if (sscanf(line, "truecolor=%u", &a) == 1) c.truecolor = a;
+                else if (sscanf(line, "rep=%u", &a) == 1) c.rep = a;
+                else if (sscanf(line, "ech=%u", &a) == 1) c.ech = a;
+                else if (sscanf(line, "sync=%u", &a) == 1) c.sync = a;
+                else if (sscanf(line, "da2=%u;%u", &a, &b) == 2) {
+                        c.da2_id = (uint16_t)a;
+                        c.da2_version = b;
+                }
+        }
+        fclose(f);
+
+        k->caps = c;
+        return true;
+}
+
+/**
+ * @brief Writes the probed profile to the cache (atomically, via rename).
+ */
+static void _kiloc_caps_save(void)
+{
+        const struct kiloc_caps *c = &k->caps;
+        char path[512], tmp[544];
+        FILE *f;
+
+        if (!_kiloc_caps_path(path, sizeof(path))) return;
+
+        // Create the missing directories along the path.
+        for (char *s = strchr(path + 1, '/'); s != NULL; s = strchr(s + 1, '/')) {
+                *s = '\0';
+                mkdir(path, 0700);
+                *s = '/';
+        }
+
+        snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+        if ((f = fopen(tmp, "w")) == NULL) return;
+        fprintf(f, "truecolor=%d\nrep=%d\nech=%d\nsync=%d\nda2=%u;%u\n",
+                c->truecolor, c->rep, c->ech, c->sync, c->da2_id, c->da2_version);
+        if (fclose(f) != 0 || rename(tmp, path) != 0)
+                unlink(tmp);
+}
+
+/**
+ * @brief Ends the probe.
+ * @param answered True if the terminal answered DA1 (the profile is complete).
+ */
+static void _kiloc_caps_done(bool answered)
+{
+        if (!k->probing) return;
+
+        k->probing = false;
+        k->caps.probed = true;
+        kiloc_del_timer(k->probe_timer);
+        k->probe_timer = -1;
+
+        if (answered)
+                _kiloc_caps_save();
+}
+
+/**
+ * @brief Enables truecolor, repainting cells already sent with the 256-color fallback.
+ */
+static void _kiloc_caps_truecolor(void)
+{
+        if (k->caps.truecolor) return;
+
+        k->caps.truecolor = true;
+        k->resized = true;
+        kiloc_request_frame();
+}
+
+/**
+ * @brief Seeds the capabilities from TERM and COLORTERM.
+ */
+static void _kiloc_caps_hints(void)
+{
+        const char *term = getenv("TERM");
+        const char *ct = getenv("COLORTERM");
+        struct kiloc_caps *c = &k->caps;
+
+        memset(c, 0, sizeof(*c));
+        if (term == NULL) term = "";
+
+        // Without a terminal to ask (Txt and Str modes, other backends), keep the truecolor dialect.
+        c->truecolor = k->mode == Txt || k->mode == Str || !k->be->tty
+                       || (ct && (strcmp(ct, "truecolor") == 0 || strcmp(ct, "24bit") == 0))
+                       || strstr(term, "direct") || strstr(term, "kitty") || strstr(term, "ghostty")
+                       || strncmp(term, "wezterm", 7) == 0 || strncmp(term, "foot", 4) == 0
+                       || strncmp(term, "alacritty", 9) == 0;
+
+        // The Linux console implements ECH but never answers XTGETTCAP.
+        c->ech = strcmp(term, "linux") == 0;
+}
+
+/**
+ * @brief Abandons the probe: whatever has not been answered is unsupported.
+ */
+static void _kiloc_caps_abandon(void)
+{
+        // Drop a reply cut short by the deadline.
+        if (k->in.state == S_DCS || k->in.state == S_DCS_ESC)
+                k->in.state = S_GROUND;
+        _kiloc_caps_done(false);
+}
+
+/**
+ * @brief Probe deadline on the event loop.
+ */
+static void _kiloc_caps_expired(int id, void *ud)
+{
+        (void)id;
+        (void)ud;
+
+        k->probe_timer = -1;    // One-shot timers are released before their callback.
+        _kiloc_caps_abandon();
+}
+
+/**
+ * @brief Sends the capability queries (Win mode), unless a cached profile exists.
+ *
+ * DA1 goes last: every terminal answers it and replies arrive in order, so
+ * its reply means nothing else is coming.
+ */
+static void _kiloc_caps_probe(void)
+{
+        bool truecolor = k->caps.truecolor;
+
+        if (_kiloc_caps_load()) {
+                // An environment hint is never overruled by an older cache entry.
+                k->caps.truecolor |= truecolor;
+                return;
+        }
+
+        _kiloc_puts("\033[?2026$p" CAPS_XTGETTCAP "\033[>c" "\033[c");
+        k->probing = true;
+        k->probe_deadline = _kiloc_now_ns() + KILOC_PROBE_MS * 1000000ULL;
+}
+
+/**
+ * @brief Arms the probe deadline on the event loop (called by kiloc_run).
+ */
+static void _kiloc_caps_arm(void)
+{
+        uint64_t now = _kiloc_now_ns();
+
+        if (!k->probing || k->probe_timer >= 0) return;
+
+        uint32_t ms = now < k->probe_deadline ? (uint32_t)((k->probe_deadline - now) / 1000000) : 0;
+        k->probe_timer = kiloc_add_timer(ms, false, _kiloc_caps_expired, NULL);
+}
+
+/**
+ * @brief Reads the probe replies already there, without waiting (kiloc_render
+ * outside the event loop), and abandons the probe past its deadline.
+ *
+ * Input read along with the replies is parsed as usual, but its events are
+ * held until the application takes input.
+ */
+static void _kiloc_caps_poll(void)
+{
+        struct pollfd pfd = { .fd = k->be->in_fd, .events = POLLIN };
+        char buf[256];
+        ssize_t n;
+
+        k->holding = true;
+        while (k->probing && !k->replay && poll(&pfd, 1, 0) > 0
+               && (n = k->be->read(k->be->ud, buf, sizeof(buf))) > 0)
+                kiloc_input_feed(buf, (size_t)n);
+        k->holding = false;
+
+        if (k->probing && _kiloc_now_ns() >= k->probe_deadline)
+                _kiloc_caps_abandon();
+}
+
+/**
+ * @brief Handles a probe reply delivered as a CSI sequence.
+ * @param final The final byte.
+ */
+static void _kiloc_caps_csi(uint8_t final)
+{
+        struct kiloc_parser *p = &k->in;
+
+        // Replies in a replay were meant for the recording's terminal.
+        if (!k->probing || k->replay) return;
+
+        if (p->priv == '?' && p->inter == '$' && final == 'y') {
+                // DECRPM: CSI ? 2026 ; Ps $ y (1 set, 2 reset; 0 and 4 mean unsupported).
+                uint32_t ps = _kiloc_input_field(1, 0, 0);
+                if (_kiloc_input_field(0, 0, 0) == 2026)
+                        k->caps.sync = ps == 1 || ps == 2;
+        } else if (p->priv == '>' && final == 'c') {
+                // DA2: CSI > Pp ; Pv ; Pc c
+                k->caps.da2_id = (uint16_t)_kiloc_input_field(0, 0, 0);
+                k->caps.da2_version = _kiloc_input_field(1, 0, 0);
+        } else if (p->priv == '?' && final == 'c') {
+                // DA1: CSI ? Pc ; ... c. VT220 and later (62+) implement ECH.
+                if (_kiloc_input_field(0, 0, 0) >= 62)
+                        k->caps.ech = true;
+                _kiloc_caps_done(true);
+        }
+}
+
+/**
+ * @brief Returns the value of a hex digit, or -1.
+ */
+static int _kiloc_caps_hex(char c)
+{
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+}
+
+/**
+ * @brief Handles a probe reply delivered as a DCS string.
+ *
+ * Only XTGETTCAP successes matter: "1+r" name[=value] {; name[=value]},
+ * with hex-encoded names.
+ */
+static void _kiloc_caps_dcs(void)
+{
+        const char *s = k->in.dcs;
+
+        if (!k->probing || k->replay || strncmp(s, "1+r", 3) != 0) return;
+
+        for (s += 3; *s != '\0'; ) {
+                char name[8];
+                size_t n = 0;
+
+                while (_kiloc_caps_hex(s[0]) >= 0 && _kiloc_caps_hex(s[1]) >= 0) {
+                        if (n < sizeof(name) - 1)
+                                name[n++] = (char)(_kiloc_caps_hex(s[0]) << 4 | _kiloc_caps_hex(s[1]));
+                        s += 2;
+                }
+                name[n] = '\0';
+
+                if (strcmp(name, "RGB") == 0 || strcmp(name, "Tc") == 0)
+                        _kiloc_caps_truecolor();
+                else if (strcmp(name, "rep") == 0)
+                        k->caps.rep = true;
+                else if (strcmp(name, "ech") == 0)
+                        k->caps.ech = true;
+
+                s += strcspn(s, ";");
+                if (*s == ';') ++s;
+        }
+}
+
+/* API */
+/**
+ * @brief See header for details. Copies the capabilities in use.
+ */
+void kiloc_caps(struct kiloc_caps *out)
+{
+        *out = k->caps;
+}
+
+/**
+ * @brief See header for details. Replaces the capabilities and ends the probe.
+ */
+void kiloc_set_caps(const struct kiloc_caps *caps)
+{
+        bool kitty_keys = k->caps.kitty_keys;
+        bool truecolor = k->caps.truecolor;
+
+        if (k->probing) {
+                k->probing = false;
+                kiloc_del_timer(k->probe_timer);
+                k->probe_timer = -1;
+        }
+
+        k->caps = *caps;
+        k->caps.kitty_keys = kitty_keys;
+        k->caps.probed = true;
+
+        // Colors already on screen were encoded for the other palette.
+        if (k->caps.truecolor != truecolor) {
+                k->resized = true;
+                kiloc_request_frame();
+        }
+}
+
+
+/*-------- Inline APIs --------*/
+/* Static */
+
+/* How long kiloc_init waits for the cursor position report in Inl mode. */
+#define KILOC_CPR_MS 100
+
+/**
+ * @brief Queries the cursor column with a cursor position report.
+ *
+ * Waits at most KILOC_CPR_MS. Bytes that arrive before the report (type-ahead)
+ * go through the input parser.
+ *
+ * @return The 1-based column, or 0 if the terminal did not answer.
+ */
+static uint16_t _kiloc_inline_cpr(void)
+{
+        char buf[64];
+        size_t n = 0;
+        uint64_t end = _kiloc_now_ns() + KILOC_CPR_MS * 1000000ULL;
+
+        // Other backends have no cursor to ask about; they start on a fresh line.
+        if (!k->be->tty) return 1;
+
+        _kiloc_puts("\033[6n");
+        _kiloc_flush();
+
+        while (n < sizeof(buf) - 1) {
+                struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+                uint64_t now = _kiloc_now_ns();
+
+                if (now >= end || poll(&pfd, 1, (int)((end - now) / 1000000) + 1) <= 0
+                    || read(STDIN_FILENO, buf + n, 1) != 1)
+                        break;
+
+                // The report is CSI row ; col R.
+                if (buf[n++] == 'R') {
+                        unsigned row, col;
+                        char *esc;
+
+                        buf[n] = '\0';
+                        esc = strrchr(buf, '\033');
+                        if (esc && sscanf(esc, "\033[%u;%uR", &row, &col) == 2) {
+                                kiloc_input_feed(buf, (size_t)(esc - buf));
+                                return (uint16_t)col;
+                        }
+                }
+        }
+
+        kiloc_input_feed(buf, n);
+        return 0;
+}
+
+/**
+ * @brief Reserves the region from the start of the cursor's line down.
+ *
+ * Newlines scroll the screen if the region does not fit below the cursor;
+ * the cursor then returns to the top row. The region is redrawn in full on
+ * the next frame.
+ */
+static void _kiloc_inline_reserve(void)
+{
+        k->inl_h = (k->ter_h && k->ter_h < k->max_h) ? k->ter_h : k->max_h;
+
+        for (uint16_t i = 1; i < k->inl_h; ++i)
+                _kiloc_puts("\n");
+        if (k->inl_h > 1)
+                _kiloc_printf("\033[%dA", k->inl_h - 1);
+        _kiloc_puts("\r");
+
+        k->inl_row = 0;
+        k->resized = true;
+}
+
+/**
+ * @brief Moves the cursor to the top of the region and erases it.
+ */
+static void _kiloc_inline_clear(void)
+{
+        if (k->inl_row > 0)
+                _kiloc_printf("\033[%dA", k->inl_row);
+        _kiloc_puts("\r\033[0m\033[J");
+        k->inl_row = 0;
+}
+
+/**
+ * @brief Moves the cursor within the region relative to its current row.
+ * @param b The output buffer.
+ * @param row The region row the cursor is on; updated to y.
+ * @param x Column (0-indexed).
+ * @param y Region row (0-indexed).
+ */
+static void _kiloc_inline_move(struct kiloc_buf *b, uint16_t *row, uint16_t x, uint16_t y)
+{
+        if (y < *row)
+                _kiloc_buf_printf(b, "\033[%dA", *row - y);
+        else if (y > *row)
+                _kiloc_buf_printf(b, "\033[%dB", y - *row);
+
+        if (x == 0)
+                _kiloc_buf_put(b, "\r", 1);
+        else
+                _kiloc_buf_printf(b, "\033[%dG", x + 1);
+
+        *row = y;
+}
+
+/* API */
+/**
+ * @brief See header for details. Prints text above the inline region.
+ */
+void kiloc_inline_print(const char *text)
+{
+        size_t len;
+
+        if (k->mode != Inl || text == NULL) return;
+
+        _kiloc_inline_clear();
+        _kiloc_puts(text);
+        len = strlen(text);
+        if (len == 0 || text[len - 1] != '\n')
+                _kiloc_puts("\n");
+
+        _kiloc_inline_reserve();
+        kiloc_request_frame();
+}
+
+
+/*-------- Stream APIs --------*/
+/* Static */
+
+/**
+ * @brief Returns the row below a laid-out component and its subtree.
+ *
+ * Uses the declared sizes, so blank rows a container or box reserves count.
+ *
+ * @param c The component (abs_y set by its render).
+ */
+static uint32_t _kiloc_stream_bottom(const struct kiloc_cmp *c)
+{
+        uint32_t h = 1;
+
+        switch (c->type) {
+                case root:
+                        h = 0;
+                        break;
+                case container:
+                        h = ((struct container *)c->self)->h;
+                        break;
+                case box:
+                        h = ((struct box *)c->self)->h;
+                        break;
+                case text:
+                case binding:
+                        break;
+        }
+
+        uint32_t bottom = (uint32_t)c->abs_y + h;
+        for (uint16_t i = 0; i < c->child_count; ++i) {
+                uint32_t b = _kiloc_stream_bottom(c->children[i]);
+                if (b > bottom) bottom = b;
+        }
+        return bottom;
+}
+
+/* API */
+/**
+ * @brief See header for details. Lays out, serializes and frees one component's rows.
+ */
+void kiloc_stream(struct kiloc_cmp *c)
+{
+        if (k->mode != Str || c == NULL) return;
+
+        // The window starts at the end of the document, so the component's own
+        // coordinates are relative to it.
+        _kiloc_cmp_render(c);
+
+        uint32_t rows = _kiloc_stream_bottom(c);
+        if (rows > k->max_h) rows = k->max_h;
+
+        for (uint16_t y = 0; y < rows; ++y)
+                _kiloc_txt_row(&_kiloc_out, k->b_buffer[y], k->max_w, true);
+        _kiloc_clear_rows(0, (uint16_t)rows);
+        k->str_rows += rows;
+
+        _kiloc_flush();
+}
+
+/**
+ * @brief See header for details.
+ */
+uint64_t kiloc_stream_rows(void)
+{
+        return k->str_rows;
+}
+
+
+/*-------- Export APIs --------*/
+/* Static */
+
+/* Staging buffer of kiloc_export: it writes straight to its fd, never through
+ * _kiloc_out, so terminal output staged for the next flush is left alone. */
+static struct kiloc_buf _kiloc_exp;
+
+/* SVG cell size in pixels, and the text baseline within a cell. */
+#define SVG_CW 9
+#define SVG_CH 18
+#define SVG_BASE 14
+
+/* Distinct styles of a frame, numbered from 1 in order of first use (0 is the default style). */
+struct kiloc_palette {
+        uint64_t *keys;                 // Open-addressed style keys (0 marks a free slot).
+        uint32_t *ids;
+        uint64_t *styles;               // Style per id; styles[0] is unused.
+        uint32_t cap, n;                // cap is a power of two.
+};
+
+/**
+ * @brief Appends a NUL-terminated string to an output buffer.
+ */
+static void _kiloc_buf_str(struct kiloc_buf *b, const char *s)
+{
+        _kiloc_buf_put(b, s, strlen(s));
+}
+
+/**
+ * @brief Appends an unsigned decimal number to an output buffer.
+ */
+static void _kiloc_buf_uint(struct kiloc_buf *b, uint32_t v)
+{
+        char d[10];
+        int n = 0;
+
+        do d[sizeof(d) - 1 - n++] = (char)('0' + v % 10); while ((v /= 10) > 0);
+        _kiloc_buf_put(b, d + sizeof(d) - n, (size_t)n);
+}
+
+/**
+ * @brief Appends a color as "#rrggbb" to an output buffer.
+ */
+static void _kiloc_buf_hex(struct kiloc_buf *b, uint32_t rgb)
+{
+        static const char hex[] = "0123456789abcdef";
+        char s[7] = { '#' };
+
+        for (int i = 0; i < 6; ++i)
+                s[1 + i] = hex[(rgb >> (20 - 4 * i)) & 0xF];
+        _kiloc_buf_put(b, s, sizeof(s));
+}
+
+/**
+ * @brief Appends cell content with &, < and > escaped for HTML and SVG.
+ */
+static void _kiloc_buf_xml(struct kiloc_buf *b, const char *s)
+{
+        while (*s != '\0') {
+                size_t n = strcspn(s, "&<>");
+                _kiloc_buf_put(b, s, n);
+                s += n;
+
+                switch (*s) {
+                        case '&': _kiloc_buf_put(b, "&amp;", 5); break;
+                        case '<': _kiloc_buf_put(b, "&lt;", 4); break;
+                        case '>': _kiloc_buf_put(b, "&gt;", 4); break;
+                        default: return;
+                }
+                ++s;
+        }
+}
+
+/**
+ * @brief Returns the class id of a style, adding it to the palette if new.
+ * @return The id (0 for the default style or if memory ran out).
+ */
+static uint32_t _kiloc_palette_id(struct kiloc_palette *p, uint64_t style)
+{
+        if (style == 0) return 0;
+
+        // Keep the load factor under one half.
+        if ((p->n + 1) * 2 > p->cap) {
+                uint32_t cap = p->cap ? p->cap * 2 : 64;
+                uint64_t *keys = calloc(cap, sizeof(uint64_t));
+                uint32_t *ids = calloc(cap, sizeof(uint32_t));
+                uint64_t *styles = realloc(p->styles, (cap / 2 + 1) * sizeof(uint64_t));
+                if (keys == NULL || ids == NULL || styles == NULL) {
+                        free(keys);
+                        free(ids);
+                        if (styles) p->styles = styles;
+                        return 0;
+                }
+                p->styles = styles;
+                for (uint32_t i = 0; i < p->cap; ++i) {
+                        if (p->keys[i] == 0) continue;
+                        uint32_t j = (uint32_t)((p->keys[i] * 0x9E3779B97F4A7C15ULL) >> 32) & (cap - 1);
+                        while (keys[j] != 0) j = (j + 1) & (cap - 1);
+                        keys[j] = p->keys[i];
+                        ids[j] = p->ids[i];
+                }
+                free(p->keys);
+                free(p->ids);
+                p->keys = keys;
+                p->ids = ids;
+                p->cap = cap;
+        }
+
+        uint32_t i = (uint32_t)((style * 0x9E3779B97F4A7C15ULL) >> 32) & (p->cap - 1);
+        while (p->keys[i] != 0) {
+                if (p->keys[i] == style) return p->ids[i];
+                i = (i + 1) & (p->cap - 1);
+        }
+        p->keys[i] = style;
+        p->ids[i] = ++p->n;
+        p->styles[p->n] = style;
+        return p->n;
+}
+
+/**
+ * @brief Returns the width of the row without trailing default-style blanks.
+ */
+static uint16_t _kiloc_export_end(const struct kiloc_cell *row, uint16_t w)
+{
+        while (w > 0 && _kiloc_cell_style(&row[w - 1]) == 0
+               && (row[w - 1].content[0] == ' ' || row[w - 1].content[0] == '\0'))
+                --w;
+        return w;
+}
+
+/**
+ * @brief Appends the CSS rules of every palette class.
+ * @param svg True for SVG rules (fill) instead of HTML rules (color, background).
+ */
+static void _kiloc_export_css(struct kiloc_buf *b, const struct kiloc_palette *p, bool svg)
+{
+        for (uint32_t id = 1; id <= p->n; ++id) {
+                uint64_t style = p->styles[id];
+                uint32_t fg = (uint32_t)(style >> 40) & 0xFFFFFF;
+                uint32_t bg = (uint32_t)(style >> 16) & 0xFFFFFF;
+
+                _kiloc_buf_str(b, svg ? ".f" : ".s");
+                _kiloc_buf_uint(b, id);
+                _kiloc_buf_put(b, "{", 1);
+                if (fg != 0) {
+                        _kiloc_buf_str(b, svg ? "fill:" : "color:");
+                        _kiloc_buf_hex(b, fg);
+                        _kiloc_buf_put(b, ";", 1);
+                }
+                if (bg != 0 && !svg) {
+                        _kiloc_buf_str(b, "background:");
+                        _kiloc_buf_hex(b, bg);
+                        _kiloc_buf_put(b, ";", 1);
+                }
+                if (style & STYLE_BOLD) _kiloc_buf_str(b, "font-weight:bold;");
+                if (style & STYLE_ITALIC) _kiloc_buf_str(b, "font-style:italic;");
+                if (style & STYLE_UNDERLINE) _kiloc_buf_str(b, "text-decoration:underline;");
+                _kiloc_buf_str(b, "}\n");
+
+                // SVG paints backgrounds as rectangles with their own class.
+                if (svg && bg != 0) {
+                        _kiloc_buf_str(b, ".b");
+                        _kiloc_buf_uint(b, id);
+                        _kiloc_buf_str(b, "{fill:");
+                        _kiloc_buf_hex(b, bg);
+                        _kiloc_buf_str(b, "}\n");
+                }
+        }
+}
+
+/**
+ * @brief Builds the palette of the styles used in a frame.
+ */
+static void _kiloc_export_palette(struct kiloc_palette *p, struct kiloc_cell **buf, uint16_t rows, uint16_t cols)
+{
+        for (uint16_t y = 0; y < rows; ++y) {
+                uint64_t last = 0;
+                for (uint16_t x = 0; x < cols; ++x) {
+                        uint64_t style = _kiloc_cell_style(&buf[y][x]);
+                        if (style != last) {
+                                _kiloc_palette_id(p, style);
+                                last = style;
+                        }
+                }
+        }
+}
+
+/**
+ * @brief Writes a frame as an HTML document with one span per run of a style.
+ */
+static void _kiloc_export_html(struct kiloc_buf *b, struct kiloc_cell **buf, uint16_t rows, uint16_t cols)
+{
+        struct kiloc_palette p = { 0 };
+
+        _kiloc_export_palette(&p, buf, rows, cols);
+
+        _kiloc_buf_str(b, "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><style>\n"
+                          ".kiloc{background:#000;color:#ccc;font-family:monospace;line-height:1.2}\n");
+        _kiloc_export_css(b, &p, false);
+        _kiloc_buf_str(b, "</style></head><body><pre class=\"kiloc\">");
+
+        for (uint16_t y = 0; y < rows; ++y) {
+                const struct kiloc_cell *row = buf[y];
+                uint16_t end = _kiloc_export_end(row, cols);
+                uint64_t style = 0;
+                uint32_t cur = 0;
+
+                for (uint16_t x = 0; x < end; ++x) {
+                        if (row[x].content[0] == '\0') continue;
+                        if (_kiloc_cell_style(&row[x]) == style) {
+                                _kiloc_buf_xml(b, row[x].content);
+                                continue;
+                        }
+
+                        style = _kiloc_cell_style(&row[x]);
+                        uint32_t id = _kiloc_palette_id(&p, style);
+                        if (id != cur) {
+                                if (cur) _kiloc_buf_str(b, "</span>");
+                                if (id) {
+                                        _kiloc_buf_str(b, "<span class=\"s");
+                                        _kiloc_buf_uint(b, id);
+                                        _kiloc_buf_str(b, "\">");
+                                }
+                                cur = id;
+                        }
+                        _kiloc_buf_xml(b, row[x].content);
+                }
+                if (cur) _kiloc_buf_str(b, "</span>");
+                _kiloc_buf_put(b, "\n", 1);
+        }
+        _kiloc_buf_str(b, "</pre></body></html>\n");
+
+        free(p.keys);
+        free(p.ids);
+        free(p.styles);
+}
+
+/**
+ * @brief Writes a frame as a standalone SVG image.
+ *
+ * Each run of a style becomes one background rectangle (if it has a
+ * background) and one text element (if it is not blank). Runs also end after
+ * wide characters, whose advance the viewer's font decides.
+ */
+static void _kiloc_export_svg(struct kiloc_buf *b, struct kiloc_cell **buf, uint16_t rows, uint16_t cols)
+{
+        struct kiloc_palette p = { 0 };
+
+        _kiloc_export_palette(&p, buf, rows, cols);
+
+        _kiloc_buf_str(b, "<svg xmlns=\"http://www.w3.org/2000/svg\" xml:space=\"preserve\" width=\"");
+        _kiloc_buf_uint(b, (uint32_t)cols * SVG_CW);
+        _kiloc_buf_str(b, "\" height=\"");
+        _kiloc_buf_uint(b, (uint32_t)rows * SVG_CH);
+        _kiloc_buf_str(b, "\" font-family=\"monospace\" font-size=\"15\">\n<style>\ntext{fill:#ccc}\n");
+        _kiloc_export_css(b, &p, true);
+        _kiloc_buf_str(b, "</style>\n<rect width=\"100%\" height=\"100%\" fill=\"#000\"/>\n");
+
+        for (uint16_t y = 0; y < rows; ++y) {
+                const struct kiloc_cell *row = buf[y];
+                uint16_t end = _kiloc_export_end(row, cols);
+
+                for (uint16_t x = 0; x < end; ) {
+                        uint64_t style = _kiloc_cell_style(&row[x]);
+                        uint32_t id = _kiloc_palette_id(&p, style);
+                        uint16_t run = 0;
+                        bool blank = true;
+
+                        // Extend the run over cells of the same style, ending after a wide character.
+                        while (x + run < end && _kiloc_cell_style(&row[x + run]) == style) {
+                                const char *c = row[x + run].content;
+                                if (c[0] != '\0' && c[0] != ' ') blank = false;
+                                ++run;
+                                if (x + run < end && row[x + run].content[0] == '\0' && c[0] != '\0') {
+                                        ++run;
+                                        break;
+                                }
+                        }
+
+                        if (style & (0xFFFFFFULL << 16)) {
+                                _kiloc_buf_str(b, "<rect class=\"b");
+                                _kiloc_buf_uint(b, id);
+                                _kiloc_buf_str(b, "\" x=\"");
+                                _kiloc_buf_uint(b, (uint32_t)x * SVG_CW);
+                                _kiloc_buf_str(b, "\" y=\"");
+                                _kiloc_buf_uint(b, (uint32_t)y * SVG_CH);
+                                _kiloc_buf_str(b, "\" width=\"");
+                                _kiloc_buf_uint(b, (uint32_t)run * SVG_CW);
+                                _kiloc_buf_str(b, "\" height=\"" );
+                                _kiloc_buf_uint(b, SVG_CH);
+                                _kiloc_buf_str(b, "\"/>\n");
+                        }
+
+                        if (!blank) {
+                                _kiloc_buf_str(b, "<text");
+                                if (id) {
+                                        _kiloc_buf_str(b, " class=\"f");
+                                        _kiloc_buf_uint(b, id);
+                                        _kiloc_buf_put(b, "\"", 1);
+                                }
+                                _kiloc_buf_str(b, " x=\"");
+                                _kiloc_buf_uint(b, (uint32_t)x * SVG_CW);
+                                _kiloc_buf_str(b, "\" y=\"");
+                                _kiloc_buf_uint(b, (uint32_t)y * SVG_CH + SVG_BASE);
+                                _kiloc_buf_str(b, "\">");
+                                for (uint16_t i = 0; i < run; ++i)
+                                        _kiloc_buf_xml(b, row[x + i].content);
+                                _kiloc_buf_str(b, "</text>\n");
+                        }
+                        x += run;
+                }
+        }
+        _kiloc_buf_str(b, "</svg>\n");
+
+        free(p.keys);
+        free(p.ids);
+        free(p.styles);
+}
+
+/* API */
+/**
+ * @brief See header for details. Serializes the frame on screen.
+ */
+int kiloc_export(enum kiloc_export_format fmt, int fd)
+{
+        struct kiloc_cell **buf = k->f_buffer ? k->f_buffer : k->b_buffer;
+        struct kiloc_buf *b = &_kiloc_exp;
+        uint16_t rows = k->max_h, cols = k->max_w;
+
+        if (buf == NULL) {
+                errno = EINVAL;
+                return -1;
+        }
+
+        // The inline region is clipped to the terminal.
+        if (k->mode == Inl) {
+                rows = k->inl_h;
+                if (k->ter_w < cols) cols = k->ter_w;
+        }
+
+        b->be = NULL;
+        b->fd = fd;
+        b->err = false;
+        b->len = 0;
+
+        switch (fmt) {
+                case KILOC_EXPORT_TEXT:
+                        for (uint16_t y = 0; y < rows; ++y)
+                                _kiloc_txt_row(b, buf[y], cols, false);
+                        break;
+                case KILOC_EXPORT_ANSI: {
+                        // A redraw from scratch, as for a new sink: nothing on screen is trusted.
+                        struct kiloc_enc e = { .b = b, .caps = &k->caps, .rows = rows, .cols = cols, .ter_w = cols };
+
+                        _kiloc_buf_put(b, "\033[0m\033[2J", 8);
+                        _kiloc_encode(&e, NULL, buf, false);
+                        _kiloc_buf_printf(b, "\033[%u;1H", rows + 1);
+                        break;
+                }
+                case KILOC_EXPORT_HTML:
+                        _kiloc_export_html(b, buf, rows, cols);
+                        break;
+                case KILOC_EXPORT_SVG:
+                        _kiloc_export_svg(b, buf, rows, cols);
+                        break;
+        }
+
+        _kiloc_buf_flush(b);
+        return b->err ? -1 : 0;
+}
+
+
+/*-------- Backend APIs --------*/
+/* Static */
+
+/* Headless backend state. */
+static struct {
+        char *out;                      // Bytes written since the last kiloc_headless_clear.
+        size_t len, cap;
+        uint16_t w, h;                  // Reported screen size.
+} _kiloc_hl;
+
+/**
+ * @brief Headless backend: appends the bytes to the capture.
+ */
+static int _kiloc_hl_write(void *ud, const char *buf, size_t len)
+{
+        (void)ud;
+        if (_kiloc_hl.len + len > _kiloc_hl.cap) {
+                size_t cap = _kiloc_hl.cap ? _kiloc_hl.cap : KILOC_BUF;
+                while (cap < _kiloc_hl.len + len) cap *= 2;
+                char *out = (char *)realloc(_kiloc_hl.out, cap);
+                if (out == NULL) return -1;
+                _kiloc_hl.out = out;
+                _kiloc_hl.cap = cap;
+        }
+        memcpy(_kiloc_hl.out + _kiloc_hl.len, buf, len);
+        _kiloc_hl.len += len;
+        return 0;
+}
+
+/**
+ * @brief Headless backend: reports the size given to kiloc_headless.
+ */
+static bool _kiloc_hl_size(void *ud, uint16_t *w, uint16_t *h)
+{
+        (void)ud;
+        *w = _kiloc_hl.w;
+        *h = _kiloc_hl.h;
+        return true;
+}
+
+/**
+ * @brief Headless backend: there is no input.
+ */
+static ssize_t _kiloc_hl_read(void *ud, char *buf, size_t len)
+{
+        (void)ud;
+        (void)buf;
+        (void)len;
+        return 0;
+}
+
+static const struct kiloc_backend _kiloc_headless = {
+        .write = _kiloc_hl_write,
+        .size = _kiloc_hl_size,
+        .read = _kiloc_hl_read,
+        .in_fd = -1,
+        .tty = false,
+};
+
+/* API */
+/**
+ * @brief See header for details. Only takes effect before kiloc_init.
+ */
+void kiloc_set_backend(const struct kiloc_backend *be)
+{
+        if (k->active) return;
+        k->be = be;
+}
+
+/**
+ * @brief See header for details. A resize is picked up by the next frame.
+ */
+void kiloc_headless(uint16_t w, uint16_t h)
+{
+        _kiloc_hl.w = w;
+        _kiloc_hl.h = h;
+
+        if (!k->active) {
+                k->be = &_kiloc_headless;
+        } else if (k->be == &_kiloc_headless) {
+                _kiloc_winch = 1;
+                kiloc_request_frame();
+        }
+}
+
+/**
+ * @brief See header for details.
+ */
+const char *kiloc_headless_output(size_t *len)
+{
+        *len = _kiloc_hl.len;
+        return _kiloc_hl.out;
+}
+
+/**
+ * @brief See header for details.
+ */
+void kiloc_headless_clear(void)
+{
+        free(_kiloc_hl.out);
+        _kiloc_hl.out = NULL;
+        _kiloc_hl.len = _kiloc_hl.cap = 0;
+}
+
+/**
+ * @brief See header for details.
+ */
+const struct kiloc_cell *kiloc_headless_cell(uint16_t x, uint16_t y)
+{
+        struct kiloc_cell **buf = k->f_buffer ? k->f_buffer : k->b_buffer;
+
+        if (buf == NULL || x >= k->max_w || y >= k->max_h) return NULL;
+        return &buf[y][x];
+}
+
+
+/*-------- Remote session APIs --------*/
+/* Static */
+
+/* Message kinds of the remote session protocol. */
+#define KILOC_RMSG_FRAME        1       // Server to client: changed cells of a frame.
+#define KILOC_RMSG_EVENT        2       // Client to server: an input event.
+
+/* Frame flags. */
+#define KILOC_RMSG_FULL         0x1     // Every cell that is not blank follows (clear first).
+#define KILOC_RMSG_MOUSE        0x2     // The server wants mouse reports.
+#define KILOC_RMSG_MOTION       0x4     // ... including motion.
+
+/* Largest message accepted from the peer. */
+#define KILOC_RMSG_MAX          (16u << 20)
+
+/* Header of every message. */
+struct kiloc_rmsg {
+        uint32_t len;                   // Payload bytes following the header.
+        uint8_t type;                   // KILOC_RMSG_FRAME or KILOC_RMSG_EVENT.
+        uint8_t flags;                  // KILOC_RMSG_FULL/MOUSE/MOTION (frames).
+        uint16_t w, h;                  // Canvas size (frames).
+};
+
+/* A frame payload is a sequence of runs: changed cells of one row sharing a
+ * style. Each cell follows as a length byte and its UTF-8 bytes (length 0 for
+ * the right half of a wide character). */
+struct kiloc_rrun {
+        uint16_t x, y, n;
+        uint16_t pad;
+        uint64_t style;
+};
+
+/* Frame messages encoded for the current frame (shared by all clients). */
+static struct kiloc_rbuf _kiloc_rs_diff, _kiloc_rs_full;
+
+/* Flags of the last frame message, to notice changes without cell changes. */
+static uint8_t _kiloc_rs_flags;
+
+/**
+ * @brief Makes room for n more bytes in a growable buffer.
+ * @return False if out of memory.
+ */
+static bool _kiloc_rbuf_reserve(struct kiloc_rbuf *b, size_t n)
+{
+        if (b->len + n > b->cap) {
+                size_t cap = b->cap ? b->cap : 4096;
+                while (cap < b->len + n) cap *= 2;
+                char *data = (char *)realloc(b->data, cap);
+                if (data == NULL) return false;
+                b->data = data;
+                b->cap = cap;
+        }
+        return true;
+}
+
+/**
+ * @brief Appends bytes to a growable buffer.
+ * @return False if out of memory.
+ */
+static bool _kiloc_rbuf_put(struct kiloc_rbuf *b, const void *p, size_t n)
+{
+        if (!_kiloc_rbuf_reserve(b, n)) return false;
+        memcpy(b->data + b->len, p, n);
+        b->len += n;
+        return true;
+}
+
+/**
+ * @brief Changes the epoll events of an fd registered with kiloc_add_fd.
+ */
+static void _kiloc_fd_mod(int fd, uint32_t events)
+{
+        for (uint16_t i = 0; i < k->n_watches; ++i) {
+                if (k->watches[i].fd == fd) {
+                        struct epoll_event ev = { .events = events, .data.u64 = EP_TAG(EP_WATCH, i) };
+                        epoll_ctl(k->epfd, EPOLL_CTL_MOD, fd, &ev);
+                        return;
+                }
+        }
+}
+
+/**
+ * @brief Sends as much of a connection's queue as the socket takes.
+ *
+ * EPOLLOUT is requested exactly while bytes remain.
+ *
+ * @return 0 on success, -1 if the connection failed.
+ */
+static int _kiloc_rconn_flush(struct kiloc_rconn *c)
+{
+        while (c->out_off < c->out.len) {
+                ssize_t r = c->sock ? send(c->fd, c->out.data + c->out_off, c->out.len - c->out_off, MSG_NOSIGNAL)
+                                    : write(c->fd, c->out.data + c->out_off, c->out.len - c->out_off);
+                if (r == -1) {
+                        if (errno == EINTR) continue;
+                        if (errno == EAGAIN) break;
+                        return -1;
+                }
+                c->out_off += (size_t)r;
+        }
+        if (c->out_off == c->out.len)
+                c->out.len = c->out_off = 0;
+
+        bool want = c->out.len > 0;
+        if (want != c->want_out) {
+                _kiloc_fd_mod(c->fd, (c->write_only ? 0 : EPOLLIN) | (want ? EPOLLOUT : 0));
+                c->want_out = want;
+        }
+        return 0;
+}
+
+/**
+ * @brief Sends bytes on a connection, queueing what the fd does not take.
+ *
+ * The bytes are shared by several connections, so they are only copied
+ * when they cannot be written right away.
+ *
+ * @return 0 on success, -1 if the connection failed.
+ */
+static int _kiloc_rconn_send(struct kiloc_rconn *c, const char *data, size_t len)
+{
+        if (c->out.len == 0) {
+                while (len > 0) {
+                        ssize_t r = c->sock ? send(c->fd, data, len, MSG_NOSIGNAL) : write(c->fd, data, len);
+                        if (r == -1) {
+                                if (errno == EINTR) continue;
+                                if (errno == EAGAIN) break;
+                                return -1;
+                        }
+                        data += r;
+                        len -= (size_t)r;
+                }
+                if (len == 0) return 0;
+        }
+        if (!_kiloc_rbuf_put(&c->out, data, len)) return -1;
+        return _kiloc_rconn_flush(c);
+}
+
+/**
+ * @brief Reads everything available from a connection.
+ * @return 1 if the connection is open, 0 on end of stream, -1 on error.
+ */
+static int _kiloc_rconn_recv(struct kiloc_rconn *c)
+{
+        for (;;) {
+                if (!_kiloc_rbuf_reserve(&c->in, 4096)) return -1;
+
+                ssize_t r = recv(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len, 0);
+                if (r > 0) {
+                        c->in.len += (size_t)r;
+                        continue;
+                }
+                if (r == 0) return 0;
+                if (errno == EINTR) continue;
+                return errno == EAGAIN ? 1 : -1;
+        }
+}
+
+/**
+ * @brief Takes the next complete message from a connection's input.
+ * @param c The connection.
+ * @param pos Offset in c->in; advanced past the message.
+ * @param h Receives the header.
+ * @param payload Receives the payload.
+ * @return 1 for a message, 0 if more bytes are needed, -1 if the peer misbehaves.
+ */
+static int _kiloc_rconn_next(struct kiloc_rconn *c, size_t *pos, struct kiloc_rmsg *h, const char **payload)
+{
+        if (c->in.len - *pos < sizeof(*h)) return 0;
+
+        memcpy(h, c->in.data + *pos, sizeof(*h));
+        if (h->len > KILOC_RMSG_MAX) return -1;
+        if (c->in.len - *pos - sizeof(*h) < h->len) return 0;
+
+        *payload = c->in.data + *pos + sizeof(*h);
+        *pos += sizeof(*h) + h->len;
+        return 1;
+}
+
+/**
+ * @brief Drops the parsed part of a connection's input.
+ */
+static void _kiloc_rconn_consume(struct kiloc_rconn *c, size_t pos)
+{
+        memmove(c->in.data, c->in.data + pos, c->in.len - pos);
+        c->in.len -= pos;
+}
+
+/**
+ * @brief Closes a connection and releases its buffers.
+ */
+static void _kiloc_rconn_close(struct kiloc_rconn *c)
+{
+        if (c->fd >= 0) {
+                if (k->epfd >= 0) kiloc_del_fd(c->fd);
+                close(c->fd);
+        }
+        free(c->out.data);
+        free(c->in.data);
+        memset(c, 0, sizeof(*c));
+        c->fd = -1;
+}
+
+/**
+ * @brief Encodes the front buffer as a frame message.
+ *
+ * @param m Receives the message (replacing its content).
+ * @param full Encode against a blank screen instead of the last frame sent.
+ * @return False if no cell changed.
+ */
+static bool _kiloc_rs_encode(struct kiloc_rbuf *m, bool full)
+{
+        static const struct kiloc_cell blank = { .content = " " };
+        struct kiloc_rmsg h = { .type = KILOC_RMSG_FRAME, .w = k->max_w, .h = k->max_h };
+        bool any = false;
+
+        h.flags = (full ? KILOC_RMSG_FULL : 0) | _kiloc_rs_flags;
+        m->len = 0;
+        _kiloc_rbuf_put(m, &h, sizeof(h));
+
+        for (uint16_t y = 0; y < k->max_h; ++y) {
+                const struct kiloc_cell *row = k->f_buffer[y];
+                const struct kiloc_cell *sent = k->rs_sent + (size_t)y * k->max_w;
+
+                if (!full && memcmp(row, sent, k->max_w * sizeof(*row)) == 0)
+                        continue;
+
+                for (uint16_t x = 0; x < k->max_w; ) {
+                        const struct kiloc_cell *ref = full ? &blank : &sent[x];
+                        if (_kiloc_cell_eq(&row[x], ref)) {
+                                ++x;
+                                continue;
+                        }
+
+                        // Extend the run over changed cells of the same style.
+                        struct kiloc_rrun run = { .x = x, .y = y, .n = 1, .style = row[x].style };
+                        while (x + run.n < k->max_w && run.n < UINT16_MAX && row[x + run.n].style == run.style
+                               && !_kiloc_cell_eq(&row[x + run.n], full ? &blank : &sent[x + run.n]))
+                                ++run.n;
+
+                        _kiloc_rbuf_put(m, &run, sizeof(run));
+                        for (uint16_t i = 0; i < run.n; ++i) {
+                                const char *s = row[x + i].content;
+                                uint8_t len = (uint8_t)strnlen(s, sizeof(row->content) - 1);
+                                _kiloc_rbuf_put(m, &len, 1);
+                                _kiloc_rbuf_put(m, s, len);
+                        }
+                        x += run.n;
+                        any = true;
+                }
+        }
+
+        h.len = (uint32_t)(m->len - sizeof(h));
+        memcpy(m->data, &h, sizeof(h));
+        return any;
+}
+
+/**
+ * @brief Queues a full frame for a client that is new or fell behind.
+ */
+static void _kiloc_rs_catchup(struct kiloc_rconn *c)
+{
+        if (_kiloc_rs_full.len == 0)
+                _kiloc_rs_encode(&_kiloc_rs_full, true);
+        c->full = false;
+        if (_kiloc_rconn_send(c, _kiloc_rs_full.data, _kiloc_rs_full.len) == -1)
+                _kiloc_rconn_close(c);
+}
+
+/**
+ * @brief Sends the frame just rendered to every client (called by kiloc_render).
+ *
+ * Clients with unsent bytes skip this diff and are marked for a full frame.
+ */
+static void _kiloc_rs_frame(void)
+{
+        uint8_t flags = (k->mouse_on ? KILOC_RMSG_MOUSE : 0) | (k->mouse_motion ? KILOC_RMSG_MOTION : 0);
+        bool changed = flags != _kiloc_rs_flags;
+        bool encoded = false;
+
+        _kiloc_rs_flags = flags;
+        _kiloc_rs_full.len = 0;
+
+        for (uint16_t i = 0; i < k->n_rs_conns; ++i) {
+                struct kiloc_rconn *c = &k->rs_conns[i];
+                if (c->fd < 0) continue;
+
+                if (c->out.len > 0) {
+                        c->full = true;
+                        continue;
+                }
+                if (c->full) {
+                        _kiloc_rs_catchup(c);
+                        continue;
+                }
+
+                if (!encoded) {
+                        changed |= _kiloc_rs_encode(&_kiloc_rs_diff, false);
+                        encoded = true;
+                }
+                if (changed && _kiloc_rconn_send(c, _kiloc_rs_diff.data, _kiloc_rs_diff.len) == -1)
+                        _kiloc_rconn_close(c);
+        }
+
+        memcpy(k->rs_sent, k->f_buffer[0], (size_t)k->max_w * k->max_h * sizeof(struct kiloc_cell));
+}
+
+/**
+ * @brief Delivers an event message from a client as local input.
+ */
+static void _kiloc_rs_event(const char *payload, uint32_t len)
+{
+        struct kiloc_event ev;
+
+        if (len < sizeof(ev)) return;
+        memcpy(&ev, payload, sizeof(ev));
+        ev.ts = _kiloc_now_ns();
+
+        switch (ev.type) {
+                case KILOC_EV_KEY:
+                        break;
+                case KILOC_EV_MOUSE:
+                        // The client has no components; hit-test here.
+                        ev.mouse.target = ev.mouse.inside ? kiloc_hit(ev.mouse.x, ev.mouse.y) : 0;
+                        break;
+                case KILOC_EV_PASTE:
+                        ev.paste.data = payload + sizeof(ev);
+                        ev.paste.len = len - sizeof(ev);
+                        break;
+                default:
+                        return;
+        }
+        _kiloc_emit(&ev);
+        k->frame_req = true;
+}
+
+/**
+ * @brief Event loop callback of a client connection.
+ */
+static void _kiloc_rs_io(int fd, uint32_t events, void *ud)
+{
+        struct kiloc_rconn *conns = k->rs_conns;
+        struct kiloc_rconn *c = &conns[(uintptr_t)ud];
+        struct kiloc_rmsg h;
+        const char *payload;
+        size_t pos = 0;
+        int r;
+
+        (void)fd;
+        if (events & EPOLLOUT) {
+                if (_kiloc_rconn_flush(c) == -1) {
+                        _kiloc_rconn_close(c);
+                        return;
+                }
+                // Caught up: replace the skipped diffs with the current frame.
+                if (c->full && c->out.len == 0)
+                        _kiloc_rs_catchup(c);
+                if (c->fd < 0) return;
+        }
+        if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                return;
+
+        int open = _kiloc_rconn_recv(c);
+        while ((r = _kiloc_rconn_next(c, &pos, &h, &payload)) == 1) {
+                if (h.type != KILOC_RMSG_EVENT) continue;
+                _kiloc_rs_event(payload, h.len);
+
+                // The event callbacks may have shut the session down or, by
+                // rendering, closed this client and freed its input.
+                if (!k->active || k->rs_conns != conns || c->fd < 0) return;
+        }
+
+        if (open <= 0 || r == -1) {
+                _kiloc_rconn_close(c);
+                return;
+        }
+        _kiloc_rconn_consume(c, pos);
+}
+
+/**
+ * @brief Event loop callback of the listening socket: accepts new clients.
+ */
+static void _kiloc_rs_accept(int fd, uint32_t events, void *ud)
+{
+        int cfd;
+
+        (void)events;
+        (void)ud;
+        while ((cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                uint16_t i;
+                for (i = 0; i < k->n_rs_conns; ++i)
+                        if (k->rs_conns[i].fd < 0) break;
+
+                if (i == k->n_rs_conns) {
+                        struct kiloc_rconn *conns = realloc(k->rs_conns, (k->n_rs_conns + 1) * sizeof(struct kiloc_rconn));
+                        if (conns == NULL) {
+                                close(cfd);
+                                continue;
+                        }
+                        k->rs_conns = conns;
+                        memset(&k->rs_conns[i], 0, sizeof(struct kiloc_rconn));
+                        k->rs_conns[i].fd = -1;
+                        k->n_rs_conns++;
+                }
+
+                if (kiloc_add_fd(cfd, EPOLLIN, _kiloc_rs_io, (void *)(uintptr_t)i) == -1) {
+                        close(cfd);
+                        continue;
+                }
+                k->rs_conns[i].fd = cfd;
+                k->rs_conns[i].sock = true;
+
+                // The frame on screen first, then diffs.
+                _kiloc_rs_full.len = 0;
+                _kiloc_rs_catchup(&k->rs_conns[i]);
+        }
+}
+
+/**
+ * @brief Sends an input event to the server (attached clients).
+ */
+static void _kiloc_rc_send(const struct kiloc_event *ev)
+{
+        struct kiloc_rmsg h = { .type = KILOC_RMSG_EVENT, .len = sizeof(*ev) };
+        struct kiloc_rconn *c = k->rc;
+
+        if (ev->type == KILOC_EV_PASTE)
+                h.len += (uint32_t)ev->paste.len;
+
+        _kiloc_rbuf_put(&c->out, &h, sizeof(h));
+        _kiloc_rbuf_put(&c->out, ev, sizeof(*ev));
+        if (ev->type == KILOC_EV_PASTE)
+                _kiloc_rbuf_put(&c->out, ev->paste.data, ev->paste.len);
+        if (_kiloc_rconn_flush(c) == -1)
+                kiloc_quit();
+}
+
+/**
+ * @brief Applies a frame message to the back buffer (attached clients).
+ */
+static void _kiloc_rc_frame(const struct kiloc_rmsg *h, const char *p)
+{
+        const char *end = p + h->len;
+
+        if (h->flags & KILOC_RMSG_FULL)
+                _kiloc_clear_rows(0, k->max_h);
+
+        while ((size_t)(end - p) >= sizeof(struct kiloc_rrun)) {
+                struct kiloc_rrun run;
+                memcpy(&run, p, sizeof(run));
+                p += sizeof(run);
+
+                for (uint16_t i = 0; i < run.n && p < end; ++i) {
+                        uint8_t len = (uint8_t)*p++;
+                        if (len > 4 || (size_t)(end - p) < len) return;
+
+                        // Cells outside the canvas (a larger server) are dropped.
+                        if (run.y < k->max_h && run.x + i < k->max_w) {
+                                struct kiloc_cell *cell = &k->b_buffer[run.y][run.x + i];
+                                memcpy(cell->content, p, len);
+                                cell->content[len] = '\0';
+                                cell->style = run.style;
+                        }
+                        p += len;
+                }
+        }
+
+        bool mouse = h->flags & KILOC_RMSG_MOUSE, motion = h->flags & KILOC_RMSG_MOTION;
+        if (mouse != k->mouse_on || (mouse && motion != k->mouse_motion))
+                kiloc_mouse(mouse, motion);
+        kiloc_request_frame();
+}
+
+/**
+ * @brief Event loop callback of the server connection (attached clients).
+ */
+static void _kiloc_rc_io(int fd, uint32_t events, void *ud)
+{
+        struct kiloc_rconn *c = k->rc;
+        struct kiloc_rmsg h;
+        const char *payload;
+        size_t pos = 0;
+        int r;
+
+        (void)fd;
+        (void)ud;
+        if ((events & EPOLLOUT) && _kiloc_rconn_flush(c) == -1) {
+                kiloc_quit();
+                return;
+        }
+        if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                return;
+
+        int open = _kiloc_rconn_recv(c);
+        while ((r = _kiloc_rconn_next(c, &pos, &h, &payload)) == 1)
+                if (h.type == KILOC_RMSG_FRAME)
+                        _kiloc_rc_frame(&h, payload);
+        _kiloc_rconn_consume(c, pos);
+
+        if (open <= 0 || r == -1)
+                kiloc_quit();
+}
+
+/**
+ * @brief Forwards input events to the server while attached.
+ * @return True if the event was consumed.
+ */
+static bool _kiloc_rc_route(const struct kiloc_event *ev)
+{
+        if (k->rc == NULL || (ev->type != KILOC_EV_KEY && ev->type != KILOC_EV_MOUSE && ev->type != KILOC_EV_PASTE))
+                return false;
+
+        // Ctrl-] detaches.
+        if (ev->type == KILOC_EV_KEY && ev->key.code == ']' && ev->key.mods == KILOC_MOD_CTRL) {
+                if (ev->key.action != KILOC_KEY_RELEASE) kiloc_quit();
+                return true;
+        }
+        _kiloc_rc_send(ev);
+        return true;
+}
+
+/**
+ * @brief Reads exactly n bytes from a blocking fd.
+ * @return 0 on success, -1 on error or end of stream.
+ */
+static int _kiloc_read_full(int fd, void *buf, size_t n)
+{
+        char *p = (char *)buf;
+
+        while (n > 0) {
+                ssize_t r = read(fd, p, n);
+                if (r == -1 && errno == EINTR) continue;
+                if (r <= 0) {
+                        if (r == 0) errno = ECONNRESET;
+                        return -1;
+                }
+                p += r;
+                n -= (size_t)r;
+        }
+        return 0;
+}
+
+/**
+ * @brief Releases the remote session state (called by kiloc_shutdown).
+ */
+static void _kiloc_remote_close(void)
+{
+        for (uint16_t i = 0; i < k->n_rs_conns; ++i)
+                _kiloc_rconn_close(&k->rs_conns[i]);
+        free(k->rs_conns);
+        free(k->rs_sent);
+        if (k->rs_fd >= 0) {
+                close(k->rs_fd);
+                unlink(k->rs_addr.sun_path);
+        }
+
+        if (k->rc) {
+                _kiloc_rconn_close(k->rc);
+                free(k->rc);
+        }
+}
+
+/* API */
+/**
+ * @brief See header for details. Listens on a Unix socket.
+ */
+int kiloc_serve(const char *path)
+{
+        int fd;
+
+        if (!k->active || k->f_buffer == NULL || k->rs_fd >= 0
+            || strlen(path) >= sizeof(k->rs_addr.sun_path)) {
+                errno = EINVAL;
+                return -1;
+        }
+
+        memset(&k->rs_addr, 0, sizeof(k->rs_addr));
+        k->rs_addr.sun_family = AF_UNIX;
+        strcpy(k->rs_addr.sun_path, path);
+
+        k->rs_sent = (struct kiloc_cell *)malloc((size_t)k->max_w * k->max_h * sizeof(struct kiloc_cell));
+        if (k->rs_sent == NULL) return -1;
+        memcpy(k->rs_sent, k->f_buffer[0], (size_t)k->max_w * k->max_h * sizeof(struct kiloc_cell));
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1) goto fail;
+
+        // Replace a socket left behind by an earlier server.
+        struct stat st;
+        if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+                unlink(path);
+
+        if (bind(fd, (struct sockaddr *)&k->rs_addr, sizeof(k->rs_addr)) == -1 || listen(fd, 8) == -1
+            || kiloc_add_fd(fd, EPOLLIN, _kiloc_rs_accept, NULL) == -1) {
+                int err = errno;
+                close(fd);
+                errno = err;
+                goto fail;
+        }
+        k->rs_fd = fd;
+        return 0;
+
+fail:
+        free(k->rs_sent);
+        k->rs_sent = NULL;
+        return -1;
+}
+
+/**
+ * @brief See header for details. A kiloc_run loop showing the server's frames.
+ */
+int kiloc_attach(const char *path)
+{
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        struct kiloc_rmsg h;
+        char *payload;
+        int fd, r;
+
+        if (k->active || strlen(path) >= sizeof(addr.sun_path)) {
+                errno = EINVAL;
+                return -1;
+        }
+        strcpy(addr.sun_path, path);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) return -1;
+
+        // The first message is a full frame; its size becomes the canvas.
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+            || _kiloc_read_full(fd, &h, sizeof(h)) == -1)
+                goto fail;
+        if (h.type != KILOC_RMSG_FRAME || h.len > KILOC_RMSG_MAX || h.w == 0 || h.h == 0) {
+                errno = EPROTO;
+                goto fail;
+        }
+        payload = (char *)malloc(h.len ? h.len : 1);
+        if (payload == NULL || _kiloc_read_full(fd, payload, h.len) == -1) {
+                free(payload);
+                goto fail;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        kiloc_init(h.w, h.h, h.w, h.h, Win, false, 1);
+        k->rc = (struct kiloc_rconn *)calloc(1, sizeof(struct kiloc_rconn));
+        if (k->rc) k->rc->fd = -1;
+        if (k->rc == NULL || kiloc_add_fd(fd, EPOLLIN, _kiloc_rc_io, NULL) == -1) {
+                free(payload);
+                kiloc_shutdown();
+                goto fail;
+        }
+        k->rc->fd = fd;
+        k->rc->sock = true;
+        _kiloc_rc_frame(&h, payload);
+        free(payload);
+
+        r = kiloc_run(NULL, NULL);
+        kiloc_shutdown();
+        return r;
+
+fail:
+        r = errno;
+        close(fd);
+        errno = r;
+        return -1;
+}
+
+
+/*-------- Broadcast APIs --------*/
+/* Static */
+
+/* How long kiloc_sink_del waits for a sink to take its last bytes. */
+#define KILOC_SINK_FLUSH_MS 50
+
+/* Encodings of the current frame, one per capability profile (see _kiloc_caps_profile). */
+static struct kiloc_rbuf _kiloc_sink_enc[16];
+
+/* Staging buffer of the sink encoder, drained into one of the encodings. */
+static struct kiloc_buf _kiloc_sink_buf;
+
+/* Canvas part of the last frame (the inline region may be clipped). */
+static uint16_t _kiloc_sink_rows, _kiloc_sink_cols;
+
+/**
+ * @brief Returns the profile of the capabilities the encoder depends on.
+ * @return A 4-bit key; equal keys produce identical output.
+ */
+static uint8_t _kiloc_caps_profile(const struct kiloc_caps *c)
+{
+        return (uint8_t)(c->truecolor | c->rep << 1 | c->ech << 2 | c->sync << 3);
+}
+
+/**
+ * @brief Backend writing into a growable buffer.
+ */
+static int _kiloc_rbuf_write(void *ud, const char *buf, size_t len)
+{
+        return _kiloc_rbuf_put((struct kiloc_rbuf *)ud, buf, len) ? 0 : -1;
+}
+
+/**
+ * @brief Encodes a frame for one capability profile.
+ * @param m Receives the bytes (replacing its content).
+ * @param caps The terminal's capabilities.
+ * @param old The frame the sink shows, or NULL to redraw everything.
+ * @param cur The new frame.
+ * @param dirty Rows that may differ from old (NULL: all rows).
+ */
+static void _kiloc_sink_encode(struct kiloc_rbuf *m, const struct kiloc_caps *caps,
+                               struct kiloc_cell **old, struct kiloc_cell **cur, const uint8_t *dirty)
+{
+        struct kiloc_backend be = { .write = _kiloc_rbuf_write, .ud = m, .in_fd = -1 };
+        struct kiloc_buf *b = &_kiloc_sink_buf;
+        // The sink's width is unknown: past the canvas the cursor is not trusted.
+        struct kiloc_enc e = {
+                .b = b, .caps = caps, .rows = _kiloc_sink_rows, .cols = _kiloc_sink_cols,
+                .ter_w = _kiloc_sink_cols, .dirty = dirty,
+        };
+
+        m->len = 0;
+        b->be = &be;
+        b->len = 0;
+
+        if (caps->sync) _kiloc_buf_put(b, "\033[?2026h", 8);
+        if (old == NULL) _kiloc_buf_put(b, "\033[2J", 4);
+        _kiloc_encode(&e, old, cur, false);
+        if (caps->sync) _kiloc_buf_put(b, "\033[?2026l", 8);
+
+        _kiloc_buf_flush(b);
+        b->be = NULL;
+}
+
+/**
+ * @brief Stops broadcasting to a sink without closing its fd, whose original
+ * flags are restored.
+ */
+static void _kiloc_sink_drop(struct kiloc_sink *s)
+{
+        if (k->epfd >= 0) kiloc_del_fd(s->c.fd);
+        fcntl(s->c.fd, F_SETFL, s->flags);
+        free(s->c.out.data);
+        free(s->c.in.data);
+        memset(s, 0, sizeof(*s));
+        s->c.fd = -1;
+}
+
+/**
+ * @brief Redraws a sink that is new or fell behind.
+ * @param s The sink.
+ * @param cur The frame to show.
+ */
+static void _kiloc_sink_catchup(struct kiloc_sink *s, struct kiloc_cell **cur)
+{
+        static struct kiloc_rbuf m;
+
+        s->c.full = false;
+        _kiloc_sink_encode(&m, &s->caps, NULL, cur, NULL);
+        if (_kiloc_rconn_send(&s->c, m.data, m.len) == -1)
+                _kiloc_sink_drop(s);
+}
+
+/**
+ * @brief Event loop callback of a sink: drains its queue.
+ */
+static void _kiloc_sink_io(int fd, uint32_t events, void *ud)
+{
+        struct kiloc_sink *s = &k->sinks[(uintptr_t)ud];
+
+        (void)fd;
+        if ((events & (EPOLLERR | EPOLLHUP)) || _kiloc_rconn_flush(&s->c) == -1) {
+                _kiloc_sink_drop(s);
+                return;
+        }
+        // Caught up: redraw from the frame on screen instead of the skipped diffs.
+        if (s->c.full && s->c.out.len == 0)
+                _kiloc_sink_catchup(s, k->f_buffer);
+}
+
+/**
+ * @brief Sends the frame being rendered to every sink (called by kiloc_render
+ * before the front buffer is updated).
+ * @param rows Canvas rows drawn.
+ * @param cols Canvas columns drawn.
+ * @param dirty Rows that may have changed (NULL: all rows).
+ */
+static void _kiloc_sinks_frame(uint16_t rows, uint16_t cols, const uint8_t *dirty)
+{
+        uint16_t encoded = 0;
+
+        _kiloc_sink_rows = rows;
+        _kiloc_sink_cols = cols;
+
+        for (uint16_t i = 0; i < k->n_sinks; ++i) {
+                struct kiloc_sink *s = &k->sinks[i];
+                if (s->c.fd < 0) continue;
+
+                if (s->c.out.len > 0) {
+                        s->c.full = true;
+                        continue;
+                }
+                if (s->c.full) {
+                        _kiloc_sink_catchup(s, k->b_buffer);
+                        continue;
+                }
+
+                // One encoding per profile, shared by every sink that has it.
+                uint8_t p = _kiloc_caps_profile(&s->caps);
+                if (!(encoded & (1u << p))) {
+                        _kiloc_sink_encode(&_kiloc_sink_enc[p], &s->caps, k->f_buffer, k->b_buffer, dirty);
+                        encoded |= (uint16_t)(1u << p);
+                }
+                if (_kiloc_rconn_send(&s->c, _kiloc_sink_enc[p].data, _kiloc_sink_enc[p].len) == -1)
+                        _kiloc_sink_drop(s);
+        }
+}
+
+/**
+ * @brief Drops every sink (called by kiloc_shutdown).
+ */
+static void _kiloc_sinks_close(void)
+{
+        for (uint16_t i = 0; i < k->n_sinks; ++i)
+                if (k->sinks[i].c.fd >= 0)
+                        kiloc_sink_del(i);
+        free(k->sinks);
+
+        // The next session may have a smaller canvas.
+        _kiloc_sink_rows = 0;
+        _kiloc_sink_cols = 0;
+}
+
+/* API */
+/**
+ * @brief See header for details. Starts with a full redraw of the frame on screen.
+ */
+int kiloc_sink_add(int fd, const struct kiloc_caps *caps)
+{
+        uint16_t i;
+
+        if (!k->active || k->f_buffer == NULL || fd < 0) {
+                errno = EINVAL;
+                return -1;
+        }
+
+        for (i = 0; i < k->n_sinks; ++i)
+                if (k->sinks[i].c.fd < 0) break;
+
+        if (i == k->n_sinks) {
+                struct kiloc_sink *sinks = realloc(k->sinks, (k->n_sinks + 1) * sizeof(struct kiloc_sink));
+                if (sinks == NULL) return -1;
+                k->sinks = sinks;
+                memset(&k->sinks[i], 0, sizeof(struct kiloc_sink));
+                k->sinks[i].c.fd = -1;
+                k->n_sinks++;
+        }
+
+        int flags = fcntl(fd, F_GETFL);
+        if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+                return -1;
+        if (kiloc_add_fd(fd, 0, _kiloc_sink_io, (void *)(uintptr_t)i) == -1) {
+                fcntl(fd, F_SETFL, flags);
+                return -1;
+        }
+
+        struct kiloc_sink *s = &k->sinks[i];
+        s->c.fd = fd;
+        s->flags = flags;
+        s->c.write_only = true;
+        s->caps = caps ? *caps : k->caps;
+        if (_kiloc_sink_rows == 0) {
+                _kiloc_sink_rows = k->mode == Inl ? k->inl_h : k->max_h;
+                _kiloc_sink_cols = k->max_w;
+        }
+
+        if (_kiloc_rconn_send(&s->c, "\033[?25l", 6) == -1) {
+                _kiloc_sink_drop(s);
+                return -1;
+        }
+        _kiloc_sink_catchup(s, k->f_buffer);
+        return s->c.fd < 0 ? -1 : (int)i;
+}
+
+/**
+ * @brief See header for details. Resets the sink's style and cursor.
+ */
+void kiloc_sink_del(int id)
+{
+        if (id < 0 || id >= k->n_sinks || k->sinks[id].c.fd < 0) return;
+
+        struct kiloc_sink *s = &k->sinks[id];
+        uint64_t end = _kiloc_now_ns() + KILOC_SINK_FLUSH_MS * 1000000ULL;
+
+        // Best effort: a queued partial frame is completed first, unless the sink stalls.
+        if (_kiloc_rconn_send(&s->c, "\033[0m\033[?25h", 10) == 0) {
+                while (s->c.out.len > 0) {
+                        struct pollfd pfd = { .fd = s->c.fd, .events = POLLOUT };
+                        uint64_t now = _kiloc_now_ns();
+
+                        if (now >= end || poll(&pfd, 1, (int)((end - now) / 1000000) + 1) <= 0
+                            || _kiloc_rconn_flush(&s->c) == -1)
+                                break;
+                }
+        }
+        _kiloc_sink_drop(s);
+}
+
+
+/*-------- Asciicast APIs --------*/
+/* Static */
+
+/* How long queued records may wait for the writer thread. */
+#define KILOC_CAST_POLL_MS 100
+
+/* Header of a record in the asciicast ring; len bytes follow. */
+struct kiloc_cast_rec {
+        uint64_t ts;                    // Time (ns).
+        uint32_t len;
+        char type;                      // 'o' output, 'r' resize, 'k' keyframe (output after a marker).
+};
+
+/**
+ * @brief Copies bytes into the ring at a position, wrapping around.
+ */
+static void _kiloc_cast_copy_in(struct kiloc_cast *c, size_t pos, const void *p, size_t n)
+{
+        size_t off = pos % KILOC_CAST_RING, first = KILOC_CAST_RING - off;
+
+        if (first > n) first = n;
+        memcpy(c->ring + off, p, first);
+        memcpy(c->ring, (const char *)p + first, n - first);
+}
+
+/**
+ * @brief Copies bytes out of the ring at a position, wrapping around.
+ */
+static void _kiloc_cast_copy_out(const struct kiloc_cast *c, size_t pos, void *p, size_t n)
+{
+        size_t off = pos % KILOC_CAST_RING, first = KILOC_CAST_RING - off;
+
+        if (first > n) first = n;
+        memcpy(p, c->ring + off, first);
+        memcpy((char *)p + first, c->ring, n - first);
+}
+
+/**
+ * @brief Queues a record for the writer thread (render thread).
+ *
+ * Never blocks on the file: if the ring is full the record is dropped and
+ * the next frame becomes a keyframe.
+ */
+static void _kiloc_cast_put(char type, const char *data, size_t len)
+{
+        struct kiloc_cast *c = k->cast;
+        struct kiloc_cast_rec r = { .ts = _kiloc_now_ns(), .len = (uint32_t)len, .type = type };
+
+        pthread_mutex_lock(&c->lock);
+        if (c->head - c->tail + sizeof(r) + len > KILOC_CAST_RING) {
+                c->lost = true;
+        } else {
+                _kiloc_cast_copy_in(c, c->head, &r, sizeof(r));
+                _kiloc_cast_copy_in(c, c->head + sizeof(r), data, len);
+                c->head += sizeof(r) + len;
+                // The writer wakes up on its own every KILOC_CAST_POLL_MS; only a
+                // filling ring is worth a wakeup.
+                if (c->head - c->tail >= KILOC_CAST_RING / 4)
+                        pthread_cond_signal(&c->cond);
+        }
+        pthread_mutex_unlock(&c->lock);
+}
+
+/**
+ * @brief Records a keyframe after a frame if one is due (called by kiloc_render).
+ *
+ * A keyframe clears the screen and redraws the front buffer, so playback
+ * can start from it. In Inl mode only the region is erased and redrawn, with
+ * relative moves, and the cursor goes back to the row the next frame expects.
+ *
+ * @param rows Canvas rows drawn.
+ * @param cols Canvas columns drawn.
+ */
+static void _kiloc_cast_frame(uint16_t rows, uint16_t cols)
+{
+        static struct kiloc_rbuf m;
+        static struct kiloc_buf b;
+        struct kiloc_cast *c = k->cast;
+        uint64_t now = _kiloc_now_ns();
+
+        if (!c->lost && c->last_key && (c->key_ns == 0 || now - c->last_key < c->key_ns))
+                return;
+
+        struct kiloc_backend be = { .write = _kiloc_rbuf_write, .ud = &m, .in_fd = -1 };
+        uint16_t row = k->inl_row;
+        struct kiloc_enc e = {
+                .b = &b, .caps = &k->caps, .ox = k->offset_x, .oy = k->offset_y,
+                .rows = rows, .cols = cols, .ter_w = k->ter_w,
+                .inl_row = k->mode == Inl ? &row : NULL,
+        };
+
+        m.len = 0;
+        b.be = &be;
+        if (k->mode == Inl) {
+                if (row > 0)
+                        _kiloc_buf_printf(&b, "\033[%dA", row);
+                _kiloc_buf_put(&b, "\r\033[0m\033[J", 8);
+                row = 0;
+                _kiloc_encode(&e, NULL, k->f_buffer, false);
+                _kiloc_inline_move(&b, &row, 0, k->inl_row);
+        } else {
+                _kiloc_buf_put(&b, "\033[0m\033[2J", 8);
+                _kiloc_encode(&e, NULL, k->f_buffer, false);
+        }
+        _kiloc_buf_flush(&b);
+
+        c->lost = false;
+        _kiloc_cast_put('k', m.data, m.len);
+        c->last_key = now;
+}
+
+/**
+ * @brief Writes bytes as the contents of a JSON string.
+ *
+ * UTF-8 sequences pass through; an incomplete one at the end is left for
+ * the next call.
+ *
+ * @return Number of bytes written (len minus the incomplete tail).
+ */
+static size_t _kiloc_cast_json(FILE *f, const unsigned char *s, size_t len)
+{
+        size_t end = len;
+
+        // Leave a truncated UTF-8 sequence for the next record.
+        for (size_t i = len; i > 0 && i + 4 > len; --i) {
+                unsigned char b = s[i - 1];
+                if ((b & 0xC0) == 0x80) continue;
+                if (b >= 0xC0) {
+                        size_t need = b >= 0xF0 ? 4 : b >= 0xE0 ? 3 : 2;
+                        if (len - (i - 1) < need) end = i - 1;
+                }
+                break;
+        }
+
+        for (size_t i = 0; i < end; ++i) {
+                unsigned char ch = s[i];
+                if (ch == '"' || ch == '\\') {
+                        fputc('\\', f);
+                        fputc(ch, f);
+                } else if (ch < 0x20 || ch == 0x7F) {
+                        fprintf(f, "\\u%04x", ch);
+                } else {
+                        fputc(ch, f);
+                }
+        }
+        return end;
+}
+
+/**
+ * @brief Writer thread: turns ring records into asciicast events.
+ */
+static void *_kiloc_cast_main(void *arg)
+{
+        struct kiloc_cast *c = (struct kiloc_cast *)arg;
+        char *data = NULL, carry[4];
+        size_t cap = 0, n_carry = 0;
+
+        pthread_mutex_lock(&c->lock);
+        for (;;) {
+                while (c->head == c->tail && !c->stop) {
+                        struct timespec until;
+                        clock_gettime(CLOCK_REALTIME, &until);
+                        until.tv_nsec += KILOC_CAST_POLL_MS * 1000000L;
+                        if (until.tv_nsec >= 1000000000L) {
+                                until.tv_sec++;
+                                until.tv_nsec -= 1000000000L;
+                        }
+                        pthread_cond_timedwait(&c->cond, &c->lock, &until);
+                }
+                if (c->head == c->tail) break;
+
+                // Copy the record out, then format it without holding the lock.
+                struct kiloc_cast_rec r;
+                _kiloc_cast_copy_out(c, c->tail, &r, sizeof(r));
+                if (n_carry + r.len + 1 > cap) {
+                        char *d = (char *)realloc(data, n_carry + r.len + 1);
+                        if (d == NULL) {
+                                c->tail += sizeof(r) + r.len;
+                                continue;
+                        }
+                        data = d;
+                        cap = n_carry + r.len + 1;
+                }
+                memcpy(data, carry, n_carry);
+                _kiloc_cast_copy_out(c, c->tail + sizeof(r), data + n_carry, r.len);
+                c->tail += sizeof(r) + r.len;
+                pthread_mutex_unlock(&c->lock);
+
+                // Seconds with microseconds, formatted by hand: %f follows LC_NUMERIC.
+                unsigned long long us = r.ts > c->start ? (r.ts - c->start) / 1000 : 0;
+                char t[32];
+                snprintf(t, sizeof(t), "%llu.%06llu", us / 1000000, us % 1000000);
+
+                size_t len = n_carry + r.len;
+                if (r.type == 'r') {
+                        fprintf(c->f, "[%s, \"r\", \"%.*s\"]\n", t, (int)r.len, data + n_carry);
+                } else {
+                        if (r.type == 'k')
+                                fprintf(c->f, "[%s, \"m\", \"keyframe\"]\n", t);
+                        fprintf(c->f, "[%s, \"o\", \"", t);
+                        size_t done = _kiloc_cast_json(c->f, (unsigned char *)data, len);
+                        fputs("\"]\n", c->f);
+                        n_carry = len - done;
+                        memcpy(carry, data + done, n_carry);
+                }
+
+                pthread_mutex_lock(&c->lock);
+        }
+        pthread_mutex_unlock(&c->lock);
+
+        free(data);
+        return NULL;
+}
+
+/* API */
+/**
+ * @brief See header for details. Writes the header and starts the writer thread.
+ */
+int kiloc_cast_start(const char *path, uint32_t keyframe_ms)
+{
+        struct kiloc_cast *c;
+
+        kiloc_cast_stop();
+
+        c = (struct kiloc_cast *)calloc(1, sizeof(struct kiloc_cast));
+        if (c == NULL) return -1;
+        c->ring = (char *)malloc(KILOC_CAST_RING);
+        c->f = fopen(path, "w");
+        if (c->ring == NULL || c->f == NULL) goto fail;
+
+        fprintf(c->f, "{\"version\": 2, \"width\": %u, \"height\": %u, \"timestamp\": %lld}\n",
+                k->ter_w ? k->ter_w : k->max_w, k->ter_h ? k->ter_h : k->max_h, (long long)time(NULL));
+
+        c->start = _kiloc_now_ns();
+        c->key_ns = (uint64_t)keyframe_ms * 1000000ULL;
+        pthread_mutex_init(&c->lock, NULL);
+        pthread_cond_init(&c->cond, NULL);
+        if ((errno = pthread_create(&c->thread, NULL, _kiloc_cast_main, c)) != 0) {
+                pthread_mutex_destroy(&c->lock);
+                pthread_cond_destroy(&c->cond);
+                goto fail;
+        }
+
+        // The first frame is a keyframe.
+        k->cast = c;
+        return 0;
+
+fail:
+        if (c->f) fclose(c->f);
+        free(c->ring);
+        free(c);
+        return -1;
+}
+
+/**
+ * @brief See header for details. Joins the writer thread.
+ */
+void kiloc_cast_stop(void)
+{
+        struct kiloc_cast *c = k->cast;
+
+        if (c == NULL) return;
+        k->cast = NULL;
+
+        pthread_mutex_lock(&c->lock);
+        c->stop = true;
+        pthread_cond_signal(&c->cond);
+        pthread_mutex_unlock(&c->lock);
+        pthread_join(c->thread, NULL);
+
+        fclose(c->f);
+        pthread_mutex_destroy(&c->lock);
+        pthread_cond_destroy(&c->cond);
+        free(c->ring);
+        free(c);
+}
@@ -21,6 +21,17 @@
 #include <wchar.h>
 #include <locale.h>
 #include <string.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
 
 /** @name UTF-8 Box Drawing Characters
  * These macros define the UTF-8 bytes for basic box drawing elements.
@@ -48,7 +59,160 @@ enum cmp_type {
         root,
         container,
         text,
-        box
+        box,
+        binding
+};
+
+/**
+ * @brief Value types a binding component can read from application memory.
+ */
+enum kiloc_bind_type {
+        KILOC_BIND_I32,
+        KILOC_BIND_U32,
+        KILOC_BIND_I64,
+        KILOC_BIND_U64,
+        KILOC_BIND_F32,
+        KILOC_BIND_F64
+};
+
+/** Size of the formatted-value cache held by every binding component. */
+#define KILOC_BIND_BUF 32
+
+/**
+ * @brief Key codes for non-text keys.
+ *
+ * Text keys use their Unicode code point; Tab, Enter, Escape and Backspace use
+ * their ASCII values. Everything else is above the Unicode range.
+ */
+enum kiloc_key {
+        KILOC_KEY_TAB           = 0x09,
+        KILOC_KEY_ENTER         = 0x0D,
+        KILOC_KEY_ESC           = 0x1B,
+        KILOC_KEY_BACKSPACE     = 0x7F,
+        KILOC_KEY_UP            = 0x110000,
+        KILOC_KEY_DOWN,
+        KILOC_KEY_RIGHT,
+        KILOC_KEY_LEFT,
+        KILOC_KEY_HOME,
+        KILOC_KEY_END,
+        KILOC_KEY_INSERT,
+        KILOC_KEY_DELETE,
+        KILOC_KEY_PGUP,
+        KILOC_KEY_PGDN,
+        KILOC_KEY_F1,           // F2..F12 follow consecutively.
+        KILOC_KEY_F12           = KILOC_KEY_F1 + 11
+};
+
+/**
+ * @brief Key event kinds. Repeat and release are only reported by terminals
+ * speaking the kitty keyboard protocol.
+ */
+enum kiloc_key_action {
+        KILOC_KEY_PRESS,
+        KILOC_KEY_REPEAT,
+        KILOC_KEY_RELEASE
+};
+
+/** @name Key modifier bits (same layout as the xterm modifier parameter minus one).
+ * @{
+ */
+#define KILOC_MOD_SHIFT 0x1
+#define KILOC_MOD_ALT   0x2
+#define KILOC_MOD_CTRL  0x4
+#define KILOC_MOD_SUPER 0x8
+/** @} */
+
+/** @name Paste event flags.
+ * A paste is delivered as a BEGIN marker, zero or more data chunks and an END marker.
+ * @{
+ */
+#define KILOC_PASTE_BEGIN 0x1
+#define KILOC_PASTE_END   0x2
+/** @} */
+
+/** Maximum number of numeric parameters kept for one escape sequence. */
+#define KILOC_MAX_PARAMS 16
+
+/** Longest device control string (terminal reply) the parser keeps. */
+#define KILOC_MAX_DCS 256
+
+/**
+ * @brief State of the terminal input parser (see kiloc_input_feed).
+ *
+ * Fixed size; parsing never allocates.
+ */
+struct kiloc_parser {
+        uint8_t state;                          // Current state of the byte state machine.
+        uint8_t need;                           // UTF-8 continuation bytes still expected.
+        uint32_t cp;                            // UTF-8 code point being decoded.
+        bool alt;                               // The next decoded key was prefixed by ESC.
+        uint8_t priv;                           // CSI private marker ('<', '=', '>', '?') or 0.
+        uint8_t inter;                          // Last CSI intermediate byte or 0.
+        uint8_t n_params;                       // Number of parameters in params.
+        uint16_t colon;                         // Bit i is set if params[i] followed a ':'.
+        uint32_t params[KILOC_MAX_PARAMS];      // Numeric CSI/SS3 parameters.
+        char dcs[KILOC_MAX_DCS];                // Body of the device control string being read.
+        uint16_t dcs_len;
+        uint8_t paste_match;                    // Bytes of the paste terminator matched so far.
+        uint16_t esc_ms;                        // How long a lone ESC waits before it is a key.
+        int esc_timer;                          // Event loop timer resolving a lone ESC, or -1.
+};
+
+/**
+ * @brief Kinds of mouse reports.
+ */
+enum kiloc_mouse_action {
+        KILOC_MOUSE_PRESS,
+        KILOC_MOUSE_RELEASE,
+        KILOC_MOUSE_MOTION,
+        KILOC_MOUSE_WHEEL
+};
+
+/**
+ * @brief Event types delivered by the kiloc event loop.
+ */
+enum kiloc_event_type {
+        KILOC_EV_KEY,           // A decoded key press.
+        KILOC_EV_FRAME,         // A frame is about to be rendered.
+        KILOC_EV_RESIZE,        // The terminal size changed.
+        KILOC_EV_MOUSE,         // A mouse button, wheel or motion report.
+        KILOC_EV_PASTE          // A chunk of bracketed-paste data.
+};
+
+/**
+ * @brief An event delivered to the application by kiloc_run.
+ */
+struct kiloc_event {
+        enum kiloc_event_type type;
+        uint64_t ts;                            // Monotonic time (ns) the input was read (input events only).
+
+        union {
+                struct {
+                        uint32_t code;          // Code point or enum kiloc_key value.
+                        uint8_t mods;           // KILOC_MOD_* bits.
+                        uint8_t action;         // enum kiloc_key_action.
+                } key;                          // KILOC_EV_KEY
+
+                struct {
+                        uint16_t w, h;          // The new terminal size.
+                } resize;                       // KILOC_EV_RESIZE
+
+                struct {
+                        uint16_t x, y;          // Canvas coordinates (valid if inside).
+                        bool inside;            // The pointer is over the canvas.
+                        uint8_t action;         // enum kiloc_mouse_action.
+                        uint8_t button;         // 0 left, 1 middle, 2 right (3 if none).
+                        uint8_t mods;           // KILOC_MOD_* bits.
+                        int16_t dx, dy;         // Wheel steps (dy > 0 scrolls down).
+                        uint16_t target;        // CID of the topmost component under the pointer.
+                } mouse;                        // KILOC_EV_MOUSE
+
+                struct {
+                        const char *data;       // Pasted bytes (valid only during the callback).
+                        size_t len;             // Number of bytes (0 for the begin/end markers).
+                        uint8_t flags;          // KILOC_PASTE_BEGIN / KILOC_PASTE_END.
+                } paste;                        // KILOC_EV_PASTE
+        };
 };
 
 /**
@@ -76,6 +240,36 @@ struct box {
         uint16_t x, y, w, h;
         char *title;
         uint64_t border_style;
+        uint64_t focus_style;   // Border style while focused (0 keeps border_style).
+
+        struct kiloc_cmp *base;
+};
+
+/**
+ * @brief Runtime data structure for a data-bound component.
+ *
+ * Displays an application variable directly. The value is re-read every frame,
+ * but only re-formatted when its bits differ from the last rendered value.
+ *
+ * A full frame draws every binding like any other component. A live frame
+ * (see kiloc_set_fps) keeps the back buffer and draws a changed value over
+ * its old cells, so its cost follows the number of changes rather than the
+ * number of bindings. A binding that shares cells with another component has
+ * its row redrawn from the tree instead.
+ */
+struct binding {
+        /* Manually set */
+        uint16_t x, y;
+        const volatile void *ptr;       // The application variable to display.
+        enum kiloc_bind_type vtype;     // The type of *ptr.
+        const char *fmt;                // printf-style format for the value (NULL for a default).
+        bool atomic;                    // Read *ptr with a relaxed atomic load.
+        uint64_t style;
+
+        /* Automatically set */
+        uint64_t last;                  // Raw bits of the last formatted value.
+        bool valid;                     // Whether buf holds a formatted value.
+        char buf[KILOC_BIND_BUF];       // The last formatted value.
 
         struct kiloc_cmp *base;
 };
@@ -87,14 +281,19 @@ struct box {
  * holding the common metadata for any component type.
  */
 struct kiloc_cmp {
-        /* Manually set */
+        /* Manually set (zero-initialize the struct: focusable and on_event are read if left unset) */
         uint16_t cid;           // Component ID
         uint16_t pid;           // Parent ID
 
         enum cmp_type type;     // Specifying the component type.
+        bool focusable;         // Part of the Tab focus chain (set before kiloc_addcmp).
+        bool (*on_event)(struct kiloc_cmp *c, const struct kiloc_event *ev);    // Event handler; return true if handled.
 
         /* Automatically set */
+        bool focused;           // This component has the focus.
+        uint16_t focus_pos;     // Position in the focus chain (if focusable).
         uint16_t abs_x, abs_y;  // The absolute coordinates of the component.
+        uint16_t abs_w, abs_h;  // The size of the component's rectangle (set by the hit index).
         void *self;             // The specific pointer to the component itself.
         struct kiloc_cmp *parent;     // The parent component of this component.
         struct kiloc_cmp **children;  // The child components of this component.
@@ -106,9 +305,228 @@ struct kiloc_cmp {
  */
 enum kiloc_mode {
         Win,    // Create an interactive, continuously running terminal application.
-        Txt     // Create an application that only outputs information once.
+        Txt,    // Create an application that only outputs information once.
+        Inl,    // Like Win, but drawn in max_h rows below the cursor instead of taking over the screen.
+        Str     // Like Txt, but unbounded: top-level components stream out one after another (see kiloc_stream).
+};
+
+
+/** Maximum number of keys in one key-binding chord. */
+#define KILOC_MAX_CHORD 8
+
+/**
+ * @brief A node of the compiled key-binding trie.
+ */
+struct kiloc_bnode {
+        void (*cb)(uint16_t scope, void *ud);   // Bound action, or NULL for a pure prefix.
+        void *ud;                               // User data passed to cb.
+        uint16_t n_children;                    // Number of longer chords continuing here.
+};
+
+/**
+ * @brief An edge of the key-binding trie, stored in an open-addressing hash table.
+ */
+struct kiloc_bedge {
+        uint64_t key;                           // Packed key (code | mods << 32).
+        uint32_t from, to;                      // Parent and child node (0 marks an empty slot).
 };
 
+/** Number of buckets in a latency histogram (4 per power of two of nanoseconds). */
+#define KILOC_HIST_BUCKETS 256
+
+/**
+ * @brief A log-linear histogram of nanosecond durations.
+ */
+struct kiloc_hist {
+        uint32_t buckets[KILOC_HIST_BUCKETS];
+        uint64_t count;                         // Number of samples.
+        uint64_t max;                           // Largest sample (exact).
+};
+
+/**
+ * @brief Input-to-output latency summary (see kiloc_latency).
+ */
+struct kiloc_latency {
+        uint64_t count;                         // Frames that rendered pending input.
+        uint64_t p50_ns, p99_ns, max_ns;        // Percentiles (bucket precision) and maximum.
+};
+
+/**
+ * @brief Phases of kiloc_render timed by the frame statistics (see kiloc_frame_stats).
+ */
+enum kiloc_phase {
+        KILOC_PH_CLEAR,                         // Clearing the back buffer.
+        KILOC_PH_CMP,                           // Rendering the component tree (and overlays) into it.
+        KILOC_PH_DIFF,                          // Diffing against the front buffer and encoding, SGR excluded.
+        KILOC_PH_STYLE,                         // Encoding SGR sequences for style changes.
+        KILOC_PH_FLUSH,                         // Writing the frame out.
+        KILOC_PH_FRAME,                         // The whole kiloc_render call.
+        KILOC_PH_COUNT
+};
+
+/** Frames per half of the rolling frame statistics window (the window holds 1 to 2 halves). */
+#define KILOC_FT_WINDOW 256
+
+/**
+ * @brief Frame statistics gathered over one half of the rolling window.
+ */
+struct kiloc_ft_half {
+        struct kiloc_hist ph[KILOC_PH_COUNT];   // Duration histograms per phase.
+        uint64_t bytes;                         // Bytes written by the frames.
+        uint64_t cells;                         // Cells changed by the frames.
+        uint64_t first_ns;                      // Start of the first frame.
+        uint64_t last_ns;                       // Start of the last frame.
+};
+
+/**
+ * @brief Timing of one render phase (see kiloc_frame_stats).
+ */
+struct kiloc_phase_time {
+        uint64_t last_ns;                       // In the last frame.
+        uint64_t p50_ns, p99_ns, max_ns;        // Over the window (bucket precision) and maximum.
+};
+
+/**
+ * @brief Frame timing summary over the rolling window (see kiloc_frame_stats).
+ */
+struct kiloc_frame_stats {
+        uint64_t frames;                                // Frames in the window.
+        double fps;                                     // Frames rendered per second over the window.
+        struct kiloc_phase_time phase[KILOC_PH_COUNT];  // Indexed by enum kiloc_phase.
+        uint64_t last_bytes;                            // Bytes written by the last frame.
+        double avg_bytes;                               // Mean bytes per frame over the window.
+        uint32_t last_cells;                            // Cells changed by the last frame.
+        double avg_cells;                               // Mean cells changed per frame over the window.
+};
+
+/**
+ * @brief Render cost of one component (see kiloc_cmp_prof_top).
+ */
+struct kiloc_cmp_prof {
+        uint16_t cid;                           // Component ID.
+        uint64_t frames;                        // Profiled frames the component was rendered in.
+        uint64_t last_ns, total_ns;             // Render time, excluding its children.
+        uint32_t last_cells;                    // Cells written in the last profiled frame.
+        uint64_t total_cells;
+        uint32_t last_overdraw;                 // Of those, cells a later component overwrote.
+        uint64_t total_overdraw;
+};
+
+/**
+ * @brief Orderings of kiloc_cmp_prof_top (by the totals).
+ */
+enum kiloc_prof_key {
+        KILOC_PROF_TIME,
+        KILOC_PROF_CELLS,
+        KILOC_PROF_OVERDRAW
+};
+
+/**
+ * @brief Writer of a back buffer cell in the frame being profiled.
+ */
+struct kiloc_prof_cell {
+        uint16_t cid;                           // Last component that wrote it (0 if none).
+        uint8_t writes;                         // Components that wrote it (saturating).
+};
+
+/**
+ * @brief Kinds of bursty events that can be coalesced between frames.
+ */
+enum kiloc_coalesce_kind {
+        KILOC_CO_RESIZE,        // Keep only the last of consecutive resizes.
+        KILOC_CO_MOTION,        // Keep only the last of consecutive motions over one target component.
+        KILOC_CO_WHEEL,         // Sum consecutive wheel deltas over one target component (saturating).
+        KILOC_CO_COUNT
+};
+
+/**
+ * @brief Coalescing counters per kind (see kiloc_coalesce_stats).
+ */
+struct kiloc_coalesce_stats {
+        uint64_t seen[KILOC_CO_COUNT];          // Events produced.
+        uint64_t merged[KILOC_CO_COUNT];        // Events folded into an earlier pending one.
+};
+
+/** Maximum number of distinct coalesced events pending at once. */
+#define KILOC_CO_SLOTS 16
+
+/** Size of the chunks component payloads are allocated from. */
+#define KILOC_CHUNK 16384
+
+/**
+ * @brief A chunk of the component arena (see kiloc_shutdown).
+ */
+struct kiloc_chunk {
+        struct kiloc_chunk *next;               // Previously filled chunk.
+        size_t used, cap;                       // Bytes handed out and available in data.
+        char data[];
+};
+
+/**
+ * @brief A growable byte buffer.
+ */
+struct kiloc_rbuf {
+        char *data;
+        size_t len, cap;
+};
+
+/**
+ * @brief One end of a remote session connection (see kiloc_serve, kiloc_attach).
+ */
+struct kiloc_rconn {
+        int fd;                                 // The socket, or -1 if the slot is free.
+        bool sock;                              // fd is a socket (sent to with MSG_NOSIGNAL).
+        bool write_only;                        // Never polled for input (broadcast sinks).
+        bool full;                              // Fell behind: send a full frame once out drains.
+        bool want_out;                          // EPOLLOUT is requested (out has unsent bytes).
+        struct kiloc_rbuf out;                  // Messages not yet sent.
+        size_t out_off;                         // Bytes of out already sent.
+        struct kiloc_rbuf in;                   // Received bytes not yet parsed.
+};
+
+/** Bytes of frame output the asciicast writer may lag behind (see kiloc_cast_start). */
+#define KILOC_CAST_RING (1u << 20)
+
+/**
+ * @brief State of an asciicast recording, shared with its writer thread.
+ *
+ * The render thread appends records (a struct kiloc_cast_rec and its bytes)
+ * to a ring; the writer formats them as JSON lines. head and tail count
+ * bytes since the start and only grow. lost, key_ns and last_key belong to
+ * the render thread.
+ */
+struct kiloc_cast {
+        pthread_t thread;
+        pthread_mutex_t lock;                   // Guards ring, head, tail and stop.
+        pthread_cond_t cond;                    // Signalled when records arrive or on stop.
+        FILE *f;                                // The .cast file (writer thread only).
+        char *ring;                             // KILOC_CAST_RING bytes.
+        size_t head, tail;                      // Write and read positions.
+        bool stop;                              // The writer drains the ring and exits.
+        bool lost;                              // Output was dropped; the next frame is a keyframe.
+        uint64_t start;                         // Time (ns) of the first event.
+        uint64_t key_ns;                        // Keyframe interval.
+        uint64_t last_key;                      // Time (ns) of the last keyframe (0 for none yet).
+};
+
+/**
+ * @brief A timer registered with the event loop (backed by a timerfd).
+ */
+struct kiloc_timer {
+        int fd;                                 // The timerfd, or -1 if the slot is free.
+        void (*cb)(int id, void *ud);           // Called when the timer expires.
+        void *ud;                               // User data passed to cb.
+        bool repeat;                            // False for one-shot timers (released after firing).
+};
+
+/**
+ * @brief A user file descriptor watched by the event loop.
+ */
+struct kiloc_watch {
+        int fd;                                         // The watched fd, or -1 if the slot is free.
+        void (*cb)(int fd, uint32_t events, void *ud);  // Called with the ready epoll events.
+        void *ud;                                       // User data passed to cb.
+};
 
 /**
  * @brief Represents a single character cell in the rendering buffer.
@@ -122,6 +540,58 @@ struct kiloc_cell {
                                    and the lowest 3 bits store style information (italics, underline, bold). */
 };
 
+/**
+ * @brief Output formats of kiloc_export.
+ */
+enum kiloc_export_format {
+        KILOC_EXPORT_TEXT,      // Plain text, one line per row.
+        KILOC_EXPORT_ANSI,      // Terminal output redrawing the frame on a cleared screen.
+        KILOC_EXPORT_HTML,      // An HTML document with one CSS class per distinct style.
+        KILOC_EXPORT_SVG        // A standalone SVG image, likewise styled by class.
+};
+
+/**
+ * @brief Terminal capabilities consulted by the output encoder (see kiloc_caps).
+ *
+ * Seeded from TERM/COLORTERM and the on-disk cache at init, then refined by
+ * the replies to an asynchronous probe.
+ */
+struct kiloc_caps {
+        bool truecolor;                 // 24-bit SGR colors (otherwise the 256-color palette is used).
+        bool rep;                       // REP (CSI n b) repeats the last character.
+        bool ech;                       // ECH (CSI n X) erases characters in place.
+        bool sync;                      // Synchronized output (mode 2026).
+        bool kitty_keys;                // The kitty keyboard protocol is active.
+        bool probed;                    // The probe finished, timed out or was skipped.
+        uint16_t da2_id;                // Terminal type reported by DA2 (0 if unknown).
+        uint32_t da2_version;           // Version reported by DA2.
+};
+
+/**
+ * @brief A terminal the frames are broadcast to (see kiloc_sink_add).
+ */
+struct kiloc_sink {
+        struct kiloc_rconn c;                   // The fd and its unsent output (fd -1 if the slot is free).
+        struct kiloc_caps caps;                 // Capabilities of the terminal behind the fd.
+        int flags;                              // The fd's status flags before kiloc_sink_add (restored when dropped).
+};
+
+/**
+ * @brief Where kiloc writes its output and gets the screen size and input from
+ * (see kiloc_set_backend).
+ *
+ * The default backend is the process's terminal. Others get the same bytes
+ * but no raw mode, signal handlers or capability queries.
+ */
+struct kiloc_backend {
+        int (*write)(void *ud, const char *buf, size_t len);    // Writes all bytes; returns 0, or -1 on error.
+        bool (*size)(void *ud, uint16_t *w, uint16_t *h);       // Reports the screen size; false if unknown.
+        ssize_t (*read)(void *ud, char *buf, size_t len);       // Reads available input like read(2) on a non-blocking fd.
+        int in_fd;                                              // Polled by kiloc_run before calling read, or -1 for no input.
+        bool tty;                                               // A real terminal (raw mode, signals, queries).
+        void *ud;                                               // User data passed to the callbacks.
+};
+
 /**
  * @brief Global configuration and state structure for the kiloc framework.
  */
@@ -130,6 +600,12 @@ struct kiloc {
         uint16_t min_w, min_h, max_w, max_h;    // Minimum and maximum width/height of the window.
         uint16_t n_cmp;                         // Number of components.
         bool bdry;                              // Boolean flag to show the boundary (border) or not.
+        bool key_release;                       // Deliver key release events (kitty protocol only).
+        bool lat_overlay;                       // Draw input latency percentiles in the top-right corner.
+        bool frame_timing;                      // Time the phases of kiloc_render (see kiloc_frame_stats).
+        bool ft_overlay;                        // Draw frame statistics in the bottom-right corner (implies frame_timing).
+        bool cmp_prof;                          // Profile the render cost of each component (see kiloc_cmp_prof_top).
+        bool overdraw_overlay;                  // Tint cells written by several components (implies cmp_prof).
 
         /* Automatically set */
         uint16_t offset_x, offset_y;            // The offset value of the display area relative to the border (used to achieve center alignment).
@@ -142,11 +618,131 @@ struct kiloc {
 
         // Saving the original terminal configuration (to be restored upon exit).
         struct termios org_ter;
+        bool ter_saved;                         // org_ter holds the original settings.
+        struct sigaction old_int, old_term;     // Handlers replaced by kiloc_init.
+        bool active;                            // Between kiloc_init and kiloc_shutdown.
+        struct kiloc_chunk *arena;              // Component payload allocations.
 
         // Current terminal info.
+        const struct kiloc_backend *be;         // Output backend (NULL before kiloc_init selects the terminal).
         uint16_t ter_w, ter_h;                  // Current terminal width and height.
+        bool resized;                           // Size changed since the last frame (forces a full redraw).
+
+        struct kiloc_parser in;                 // Terminal input parser state.
+        bool kitty;                             // The kitty keyboard protocol is active.
+        struct kiloc_caps caps;                 // Capabilities the encoder relies on.
+        bool probing;                           // Probe replies are still expected.
+        uint64_t probe_deadline;                // Time (ns) after which the probe is abandoned.
+        int probe_timer;                        // Event loop timer abandoning the probe, or -1.
+        bool holding;                           // kiloc_render is reading probe replies; input events are held.
+        struct kiloc_event *held;               // Input events read by kiloc_render, in arrival order.
+        uint32_t n_held, held_cap;
+        uint64_t in_ts;                         // Read time (ns) of the input being parsed.
+        uint64_t lat_pending;                   // Read time of the earliest input not yet on screen (0 if none).
+        struct kiloc_hist lat;                  // Input-to-write latency histogram.
+
+        // Frame timing (see kiloc_frame_stats).
+        struct kiloc_ft_half ft[2];             // Current and previous half of the rolling window.
+        uint8_t ft_cur;                         // Index of the current half.
+        uint64_t ft_last[KILOC_PH_COUNT];       // Phase durations of the last frame.
+        uint64_t ft_last_bytes;                 // Bytes written by the last frame.
+        uint32_t ft_last_cells;                 // Cells changed by the last frame.
+
+        // Per-component profiling (see kiloc_cmp_prof_top).
+        struct kiloc_cmp_prof *prof;            // Indexed by cid (NULL until profiling starts).
+        struct kiloc_prof_cell *prof_cells;     // Writers of the back buffer cells, row by row.
+        bool prof_active;                       // The component tree is being rendered with profiling.
+        uint16_t prof_cid;                      // Component being rendered (0 for none).
+        uint64_t prof_child;                    // Time spent so far in the children of the current component.
+
+        // Event coalescing (see kiloc_coalesce).
+        bool co_on[KILOC_CO_COUNT];             // Coalescing enabled per kind.
+        struct kiloc_event co[KILOC_CO_SLOTS];  // Pending coalesced events, the most recently updated last.
+        uint8_t n_co;
+        struct kiloc_coalesce_stats co_stats;
+
+        // Asciicast recording of the output (see kiloc_cast_start).
+        struct kiloc_cast *cast;
+
+        // Input recording and replay (see kiloc_record_start, kiloc_replay).
+        FILE *rec;                              // Recording being written, or NULL.
+        uint64_t rec_last;                      // Time (ns) of the last record written.
+        char *replay;                           // Recording being replayed (without the magic), or NULL.
+        size_t replay_len, replay_pos;
+        bool replay_realtime;                   // Keep the recorded timing instead of running flat out.
+        int replay_fd;                          // Timerfd pacing the replay, or -1.
+
+        // Mouse state (see kiloc_mouse).
+        bool mouse_on;                          // SGR mouse reporting is enabled.
+        bool mouse_motion;                      // Motion is reported too.
+        uint16_t *hit_map;                      // Topmost CID per canvas cell (max_w * max_h).
+        bool hit_stale;                         // A frame was rendered since hit_map was built.
+
+        // Live frames (see kiloc_set_fps).
+        bool live;                              // The frame being rendered only needs binding updates.
+        bool live_ok;                           // The back buffer holds the last full frame.
+        bool delivered;                         // An event other than a frame was delivered since the last frame.
+        uint8_t *live_rows;                     // How a live frame updates each row (max_h; NULL outside Win/Inl).
+        uint16_t *live_own;                     // CID that drew each back buffer cell (0 for none, 0xFFFF for several).
+        uint16_t draw_cid;                      // CID of the component being drawn (0 outside the tree).
+        struct kiloc_cmp **binds;               // Bindings drawn by the last full frame, in order.
+        uint32_t n_binds, bind_cap;
+
+        // Focus state (see kiloc_focus).
+        uint16_t focus;                         // CID of the focused component (0 for none).
+        struct kiloc_cmp **focus_chain;         // Focusable components in traversal order.
+        uint16_t n_focus;                       // Length of focus_chain.
+        bool focus_stale;                       // The tree changed since focus_chain was built.
+
+        // Key bindings (see kiloc_bind_key).
+        struct kiloc_bnode *bnodes;             // Trie nodes; index 0 is unused.
+        uint32_t n_bnodes, bnode_cap;
+        struct kiloc_bedge *bedges;             // Trie edges hashed by (from, key).
+        uint32_t n_bedges, bedge_cap;           // bedge_cap is a power of two.
+        uint32_t *scope_root;                   // Trie root per CID (0 if the scope has no bindings).
+        uint32_t *chord_node;                   // Node the pending chord reached per CID (0 if it left the trie).
+        uint8_t chord_n;                        // Keys of the pending chord.
+        uint16_t chord_focus;                   // Focus when the pending chord started.
+        uint16_t chord_ms;                      // Time allowed between chord keys.
+        int chord_timer;                        // Event loop timer ending a pending chord, or -1.
 
         enum kiloc_mode mode;
+
+        // Stream mode state (see kiloc_stream).
+        uint64_t str_rows;                      // Rows written so far.
+
+        // Inline mode region (see kiloc_inline_print).
+        uint16_t inl_h;                         // Rows reserved below the prompt.
+        uint16_t inl_row;                       // Region row the cursor is on.
+
+        // Remote session (see kiloc_serve, kiloc_attach).
+        int rs_fd;                              // Listening socket of the server, or -1.
+        struct sockaddr_un rs_addr;             // Its address (the path is unlinked at shutdown).
+        struct kiloc_rconn *rs_conns;           // Attached clients.
+        uint16_t n_rs_conns;
+        struct kiloc_cell *rs_sent;             // The frame the up-to-date clients have (max_w * max_h).
+        struct kiloc_rconn *rc;                 // Connection to the server while attached, or NULL.
+
+        // Broadcast sinks (see kiloc_sink_add).
+        struct kiloc_sink *sinks;               // Sink slots; the index is the sink ID.
+        uint16_t n_sinks;
+
+        // Event loop state (see kiloc_run).
+        int epfd, sigfd, frame_fd;              // epoll instance, SIGWINCH signalfd and frame timerfd (-1 when closed).
+        bool winch_blocked;                     // kiloc_run blocked SIGWINCH (unblocked when it returns).
+        bool running;                           // True while kiloc_run is looping.
+        bool frame_req;                         // A frame has been requested and not rendered yet.
+        bool frame_armed;                       // The frame timerfd is armed.
+        bool pasting;                           // A bracketed paste is in flight (frames are throttled).
+        bool continuous;                        // Render on every tick even without requests.
+        uint16_t fps;                           // Maximum frames per second.
+        uint64_t last_frame;                    // Monotonic time (ns) of the last rendered frame.
+        struct kiloc_timer *timers;             // Timer slots; the index is the timer ID.
+        uint16_t n_timers;
+        struct kiloc_watch *watches;            // User fd slots.
+        uint16_t n_watches;
+        void (*on_event)(const struct kiloc_event *ev, void *ud);       // Application event callback.
+        void *ud;                               // User data passed to on_event.
 };
 
 /* APIs */
@@ -156,7 +752,13 @@ struct kiloc {
  *
  * This function must be called before any other kiloc function. It sets up UTF-8,
  * allocates buffers, initializes the root component, and configures terminal modes
- * if running in interactive (Win) mode.
+ * if running in interactive (Win) mode, which runs on the alternate screen.
+ *
+ * Inline (Inl) mode configures the terminal the same way but stays on the
+ * primary screen: it queries the cursor position, reserves max_h rows (fewer
+ * if the terminal is shorter) from the start of the next free line and
+ * addresses them relative to the cursor. The border is not drawn and mouse
+ * reports are not mapped to components in this mode.
  *
  * @param min_w Minimum required terminal width.
  * @param min_h Minimum required terminal height.
@@ -168,6 +770,18 @@ struct kiloc {
  */
 void kiloc_init(uint16_t min_w, uint16_t min_h, uint16_t max_w, uint16_t max_h, enum kiloc_mode mode, bool show_boundary, uint16_t num_comp);
 
+/**
+ * @brief Restores the terminal and releases all framework resources.
+ *
+ * Leaves the alternate screen (in Inl mode, moves the cursor below the
+ * region so the last frame stays in scrollback), disables mouse, paste and
+ * keyboard protocol modes, shows the cursor, restores the saved termios, closes event loop fds
+ * and frees buffers, indexes and component payloads in bulk. The app's own
+ * struct kiloc_cmp objects are not touched. kiloc_init may be called again
+ * afterwards. Also runs at exit; SIGINT/SIGTERM restore the terminal.
+ */
+void kiloc_shutdown(void);
+
 /**
  * @brief Writes a single UTF-8 character to the back buffer at the specified position.
  * @param x Column coordinate (0-indexed) relative to the virtual canvas.
@@ -204,6 +818,10 @@ uint64_t kiloc_make_style(uint32_t fg_rgb, uint32_t bg_rgb,
 
 /**
  * @brief Registers a new component, links it to its parent, and allocates its specific runtime data.
+ *
+ * Fields of c that are not set must be zero (e.g. declare it with a
+ * designated initializer), since focusable and on_event are always read.
+ *
  * @param c Pointer to the initialized kiloc_cmp structure.
  * @return A void pointer to the component's type-specific data (e.g., struct text *).
  */
@@ -214,9 +832,502 @@ void *kiloc_addcmp (struct kiloc_cmp *c);
  *
  * Handles terminal resize events, component tree traversal/rendering to the back buffer,
  * and performs double-buffering diff-draw to update only changed cells on the screen.
+ *
+ * In Txt mode it renders the tree once and streams the rows to the backend as
+ * plain lines (SGR only where the style changes, trailing blanks dropped),
+ * without a front buffer or cursor addressing.
+ *
+ * In Str mode it streams every top-level component (see kiloc_stream) on each
+ * call, so a second call writes them all out again. Str mode apps normally
+ * call kiloc_stream for new components instead.
  */
 void kiloc_render(void);
 
+/**
+ * @brief Prints text above the inline region (Inl mode only).
+ *
+ * The region is erased, the text is written where it started, followed by a
+ * newline if it lacks one, and the region is reserved again below it and
+ * fully redrawn on the next frame. Earlier text scrolls into scrollback like
+ * ordinary command output.
+ *
+ * @param text The text to print.
+ */
+void kiloc_inline_print(const char *text);
+
+/**
+ * @brief Renders a component at the end of the document and writes it out (Str mode only).
+ *
+ * In Str mode the canvas is a window of max_h rows that follows the end of the
+ * document. The component (with its subtree) is laid out as a top-level
+ * component whose y is the gap below the previous one; its rows are written
+ * to the backend as in Txt mode and the window is cleared for the next one. Rows
+ * below the window are clipped. The component may be changed and streamed
+ * again afterwards, so a single component can produce any number of rows.
+ *
+ * kiloc_render in Str mode streams every top-level component in order, each
+ * time it is called.
+ *
+ * @param c A registered component (normally with pid 0).
+ */
+void kiloc_stream(struct kiloc_cmp *c);
+
+/**
+ * @brief Returns the number of rows kiloc_stream has written since kiloc_init (Str mode).
+ */
+uint64_t kiloc_stream_rows(void);
+
+/**
+ * @brief Writes the frame on screen to a file descriptor.
+ *
+ * Serializes the front buffer (the back buffer in Txt and Str modes, which
+ * have none). ANSI output comes from the frame encoder, using REP and ECH
+ * as kiloc's capabilities allow, and ends with the cursor below the frame.
+ * Text drops trailing blanks from every row, and HTML/SVG merge runs of one
+ * style and get one CSS class per distinct style of the frame. Nothing is
+ * written to the terminal, and output already staged for it is neither
+ * flushed nor redirected.
+ *
+ * @param fmt The output format.
+ * @param fd The destination (file, pipe, memfd, ...).
+ * @return 0 on success, -1 on error.
+ */
+int kiloc_export(enum kiloc_export_format fmt, int fd);
+
+/**
+ * @brief Serves the UI to clients attaching through a Unix socket.
+ *
+ * Every rendered frame is sent as a diff of cells and styles (not escape
+ * sequences), so each client encodes it for its own terminal. A new client
+ * gets a full frame first; a client still busy with an earlier frame skips
+ * the diffs and gets a full frame once it has caught up, so nothing piles up
+ * for slow clients. Keys, mouse and paste events of the clients arrive as if
+ * typed locally. Needs kiloc_run and a mode with a front buffer (Win or Inl);
+ * a daemon without a terminal would use kiloc_headless.
+ *
+ * Both ends use the host's byte order and struct layout, so client and
+ * server must run the same kiloc build on the same machine.
+ *
+ * @param path The socket path (an existing socket file there is replaced).
+ * @return 0 on success, -1 on error (errno is set).
+ */
+int kiloc_serve(const char *path);
+
+/**
+ * @brief Attaches the terminal to a kiloc_serve session until it ends.
+ *
+ * Initializes kiloc in Win mode with the server's canvas size, shows the
+ * server's frames and forwards input to it. Ctrl-] detaches. Calls
+ * kiloc_shutdown before returning; kiloc must not be initialized.
+ *
+ * @param path The server's socket path.
+ * @return 0 when detached or the server went away, -1 on error (errno is set).
+ */
+int kiloc_attach(const char *path);
+
+/**
+ * @brief Broadcasts the frames to another terminal.
+ *
+ * Every frame is diffed once; each sink gets the diff encoded for its own
+ * capabilities, and sinks with the same profile (truecolor, rep, ech, sync)
+ * share one encoding. The canvas is drawn at the top-left corner of the
+ * sink. A sink still busy with an earlier frame skips the diffs and is
+ * redrawn from the current frame once it has caught up, so at most one
+ * frame is ever queued per sink. Needs a mode with a front buffer (Win or
+ * Inl); a sink that hangs up is dropped.
+ *
+ * @param fd The sink's output (a tty, pty or socket; made non-blocking until
+ *           the sink is dropped). It stays owned by the caller.
+ * @param caps The sink terminal's capabilities, or NULL for kiloc's own.
+ * @return The sink ID, or -1 on error (errno is set).
+ */
+int kiloc_sink_add(int fd, const struct kiloc_caps *caps);
+
+/**
+ * @brief Stops broadcasting to a sink (the fd is left open, with its original flags).
+ *
+ * The style and cursor are reset. Output the sink has not taken within 50 ms
+ * is dropped, so a stalled viewer never blocks the caller.
+ *
+ * @param id The ID returned by kiloc_sink_add.
+ */
+void kiloc_sink_del(int id);
+
+/**
+ * @brief Selects the output backend; call before kiloc_init.
+ *
+ * kiloc_shutdown goes back to the terminal backend.
+ *
+ * @param be The backend (must outlive the session), or NULL for the terminal.
+ */
+void kiloc_set_backend(const struct kiloc_backend *be);
+
+/**
+ * @brief Selects the headless backend, or resizes it.
+ *
+ * The headless backend has no terminal: it reports a w x h screen, has no
+ * input, and keeps every byte kiloc writes in memory along with the cell
+ * grid of the last frame (see kiloc_headless_output, kiloc_headless_cell).
+ * Called before kiloc_init it selects the backend; called afterwards it
+ * resizes the screen as a SIGWINCH would.
+ *
+ * @param w Screen width.
+ * @param h Screen height.
+ */
+void kiloc_headless(uint16_t w, uint16_t h);
+
+/**
+ * @brief Returns the bytes written to the headless backend so far.
+ *
+ * The capture survives kiloc_shutdown (so the teardown sequence is included).
+ *
+ * @param len Receives the number of bytes.
+ * @return The bytes (not NUL-terminated), or NULL if nothing was written.
+ */
+const char *kiloc_headless_output(size_t *len);
+
+/**
+ * @brief Discards the bytes captured by the headless backend and frees them.
+ */
+void kiloc_headless_clear(void);
+
+/**
+ * @brief Returns a cell of the last frame (the same grid kiloc_export reads).
+ * @param x Canvas column.
+ * @param y Canvas row.
+ * @return The cell, or NULL outside the canvas or before kiloc_init.
+ */
+const struct kiloc_cell *kiloc_headless_cell(uint16_t x, uint16_t y);
+
+/**
+ * @brief Runs the event loop until kiloc_quit is called.
+ *
+ * Multiplexes the terminal, SIGWINCH (signalfd), frame ticks and timers (timerfd)
+ * and user fds through a single epoll instance. The process sleeps while idle;
+ * frames are only rendered when requested (or on every tick in continuous mode).
+ * SIGWINCH is blocked only while the loop runs; the caller's signal mask is
+ * restored when it returns.
+ *
+ * @param on_event Callback receiving every event (may be NULL).
+ * @param ud User data passed to on_event.
+ * @return 0 on a clean exit, -1 on error (errno is set).
+ */
+int kiloc_run(void (*on_event)(const struct kiloc_event *ev, void *ud), void *ud);
+
+/**
+ * @brief Makes kiloc_run return after the current iteration.
+ */
+void kiloc_quit(void);
+
+/**
+ * @brief Requests a frame; it is rendered as soon as the frame rate allows.
+ */
+void kiloc_request_frame(void);
+
+/**
+ * @brief Sets the frame rate limit of the event loop.
+ *
+ * In continuous mode a tick with no kiloc_request_frame and no delivered
+ * event since the last frame is a live frame: the back buffer is kept, only
+ * bindings are re-read, and only the rows of changed bindings are diffed.
+ * Anything else that changes (text, boxes, the tree) needs
+ * kiloc_request_frame, as outside continuous mode; a KILOC_EV_FRAME handler
+ * may still request one. Overlays, component profiling and an attached client
+ * always get full frames.
+ *
+ * @param fps Maximum frames per second (0 keeps the default of 60).
+ * @param continuous True to render on every tick, e.g. for live bindings.
+ */
+void kiloc_set_fps(uint16_t fps, bool continuous);
+
+/**
+ * @brief Registers a timer with the event loop.
+ * @param ms Expiration time in milliseconds.
+ * @param repeat True to fire every ms milliseconds, false to fire once (the ID is released before cb runs).
+ * @param cb Callback invoked on expiration.
+ * @param ud User data passed to cb.
+ * @return The timer ID, or -1 on error.
+ */
+int kiloc_add_timer(uint32_t ms, bool repeat, void (*cb)(int id, void *ud), void *ud);
+
+/**
+ * @brief Cancels and releases a timer.
+ * @param id The timer ID returned by kiloc_add_timer.
+ */
+void kiloc_del_timer(int id);
+
+/**
+ * @brief Adds a user file descriptor to the event loop.
+ * @param fd The file descriptor.
+ * @param events The epoll events to wait for (e.g. EPOLLIN).
+ * @param cb Callback invoked with the ready events.
+ * @param ud User data passed to cb.
+ * @return 0 on success, -1 on error.
+ */
+int kiloc_add_fd(int fd, uint32_t events, void (*cb)(int fd, uint32_t events, void *ud), void *ud);
+
+/**
+ * @brief Removes a user file descriptor from the event loop.
+ * @param fd The file descriptor passed to kiloc_add_fd.
+ */
+void kiloc_del_fd(int fd);
+
+/**
+ * @brief Feeds raw terminal bytes to the input parser.
+ *
+ * Decodes UTF-8 text, C0 controls, CSI/SS3 key sequences with modifiers and
+ * ESC-prefixed Alt keys, and delivers KILOC_EV_KEY events. Sequences may be
+ * split across calls. kiloc_run calls this itself; it is public for apps
+ * that read the terminal on their own.
+ *
+ * @param buf The bytes read.
+ * @param len Number of bytes.
+ */
+void kiloc_input_feed(const char *buf, size_t len);
+
+/**
+ * @brief Resolves a pending lone ESC into an Escape key press.
+ *
+ * Called by the event loop once the ESC timeout expires; apps feeding input
+ * themselves call it when no further bytes arrived in time.
+ */
+void kiloc_input_flush(void);
+
+/**
+ * @brief Enables or disables SGR (1006) mouse reporting.
+ *
+ * Reports press, release and wheel events; with motion also pointer movement.
+ * Each event carries the CID of the topmost component under the pointer.
+ * In Inl mode the region's screen row is unknown, so events are never
+ * inside the canvas and carry target 0. Motion and wheel reports are
+ * coalesced between frames (see kiloc_coalesce).
+ *
+ * @param enable True to enable, false to disable reporting.
+ * @param motion True to also report motion (any-event tracking).
+ */
+void kiloc_mouse(bool enable, bool motion);
+
+/**
+ * @brief Returns the topmost component at a canvas position.
+ *
+ * Uses an index over the components' absolute rectangles that is rebuilt at
+ * most once per rendered frame.
+ *
+ * @param x Column on the canvas.
+ * @param y Row on the canvas.
+ * @return The CID of the component (0, the root, if none).
+ */
+uint16_t kiloc_hit(uint16_t x, uint16_t y);
+
+/**
+ * @brief Moves the focus to a component.
+ *
+ * Only the previously and newly focused components change appearance, so the
+ * next frame's diff repaints just those two.
+ *
+ * @param cid The component to focus (0 to clear the focus).
+ */
+void kiloc_focus(uint16_t cid);
+
+/**
+ * @brief Moves the focus to the next focusable component in traversal order.
+ */
+void kiloc_focus_next(void);
+
+/**
+ * @brief Moves the focus to the previous focusable component in traversal order.
+ */
+void kiloc_focus_prev(void);
+
+/**
+ * @brief Returns the CID of the focused component (0 for none).
+ */
+uint16_t kiloc_focused(void);
+
+/**
+ * @brief Dispatches an event to a component and bubbles it up through its parents.
+ *
+ * Each component's on_event is called, from cid up to the root, until one
+ * returns true.
+ *
+ * @param cid The component receiving the event first.
+ * @param ev The event.
+ * @return True if a component handled the event.
+ */
+bool kiloc_dispatch(uint16_t cid, const struct kiloc_event *ev);
+
+/**
+ * @brief Binds a key or key chord to an action within a scope.
+ *
+ * The chord is a space-separated list of keys, each an optional set of
+ * modifier prefixes ("C-"/"Ctrl-", "M-"/"Alt-", "S-"/"Shift-", "s-"/"Super-")
+ * followed by a character or a key name (Tab, Enter, Esc, Backspace, Space,
+ * Up, Down, Left, Right, Home, End, Insert, Delete, PgUp, PgDn, F1-F12),
+ * e.g. "g g" or "Ctrl-x Ctrl-s".
+ *
+ * Bindings are compiled into a hashed trie and each scope keeps the node its
+ * pending chord reached, so a key costs one lookup per scope on the focus path
+ * regardless of how many bindings exist. A scope is active while the focus is
+ * inside its subtree; inner scopes win. If a chord is also the prefix of a
+ * longer one, it fires when the chord times out or is broken by a key that
+ * does not continue it (that key is then handled on its own).
+ *
+ * @param scope CID whose subtree the binding applies to (0 for global).
+ * @param chord The chord string.
+ * @param cb Action to run (NULL removes the binding).
+ * @param ud User data passed to cb.
+ * @return 0 on success, -1 if the chord could not be parsed or stored.
+ */
+int kiloc_bind_key(uint16_t scope, const char *chord, void (*cb)(uint16_t scope, void *ud), void *ud);
+
+/**
+ * @brief Returns input-to-output latency statistics.
+ *
+ * Each sample is the time from reading the earliest input a frame reflects
+ * to that frame being written to the terminal.
+ *
+ * @param out Receives the summary.
+ */
+void kiloc_latency(struct kiloc_latency *out);
+
+/**
+ * @brief Clears the input-to-output latency statistics.
+ */
+void kiloc_latency_reset(void);
+
+/**
+ * @brief Returns per-phase frame timing over the rolling window.
+ *
+ * Frames are only timed while frame_timing or ft_overlay is set. The window
+ * covers the last KILOC_FT_WINDOW to 2 * KILOC_FT_WINDOW timed frames.
+ *
+ * @param out Receives the summary.
+ */
+void kiloc_frame_stats(struct kiloc_frame_stats *out);
+
+/**
+ * @brief Clears the frame timing statistics.
+ */
+void kiloc_frame_stats_reset(void);
+
+/**
+ * @brief Returns the components costing the most to render.
+ *
+ * Components are only profiled while cmp_prof or overdraw_overlay is set. The
+ * totals accumulate over all profiled frames until kiloc_cmp_prof_reset.
+ *
+ * @param key What to order by.
+ * @param out Receives up to n entries, the most costly first.
+ * @param n Capacity of out.
+ * @return Number of entries written.
+ */
+int kiloc_cmp_prof_top(enum kiloc_prof_key key, struct kiloc_cmp_prof *out, int n);
+
+/**
+ * @brief Clears the per-component profile.
+ */
+void kiloc_cmp_prof_reset(void);
+
+/**
+ * @brief Enables or disables coalescing of a bursty event kind.
+ *
+ * Coalesced events are held until the next frame (or the next event that is
+ * not coalesced) and then delivered merged. Each pending event stands for one
+ * kind and target (and modifiers, for the wheel), so interleaved motion over
+ * two components still merges. A merged event moves behind the other pending
+ * ones: the order of delivery is that of each event's latest update. All
+ * kinds are enabled by default.
+ *
+ * @param kind The event kind.
+ * @param enable True to coalesce, false to deliver every event immediately.
+ */
+void kiloc_coalesce(enum kiloc_coalesce_kind kind, bool enable);
+
+/**
+ * @brief Returns how many events of each kind were produced and merged.
+ * @param out Receives the counters.
+ */
+void kiloc_coalesce_stats(struct kiloc_coalesce_stats *out);
+
+/**
+ * @brief Starts recording raw terminal input and resizes to a file.
+ *
+ * Records carry microsecond time deltas and are written with the same bytes
+ * the input parser receives, so a replay exercises the exact same paths.
+ * Input flushes (the ESC timeout) and the frames kiloc_run renders are
+ * recorded too, so events are split and coalesced the same way on replay.
+ *
+ * @param path The file to create.
+ * @return 0 on success, -1 on error.
+ */
+int kiloc_record_start(const char *path);
+
+/**
+ * @brief Stops recording and closes the file.
+ */
+void kiloc_record_stop(void);
+
+/**
+ * @brief Starts recording the terminal output to an asciicast v2 file.
+ *
+ * The bytes kiloc writes are copied with their timestamps into a bounded
+ * ring (KILOC_CAST_RING) and written out by a background thread, so the
+ * render path only pays for a copy. If the writer falls that far behind,
+ * output is dropped and the next frame is recorded as a keyframe. Keyframes
+ * (a clear screen and a full redraw, preceded by a "keyframe" marker players
+ * can seek to; in Inl mode the region is cleared and redrawn in place) are
+ * also recorded periodically. Resizes become "r" events.
+ * Link with -pthread.
+ *
+ * @param path The file to create.
+ * @param keyframe_ms Time between keyframes (0 for only the first).
+ * @return 0 on success, -1 on error (errno is set).
+ */
+int kiloc_cast_start(const char *path, uint32_t keyframe_ms);
+
+/**
+ * @brief Stops the asciicast recording, writing out what is buffered.
+ */
+void kiloc_cast_stop(void);
+
+/**
+ * @brief Loads a recording to be replayed by kiloc_run.
+ *
+ * Records are fed through kiloc_input_feed and the resize path from an event
+ * loop timer, either with their original timing or as fast as possible. Live
+ * terminal input and SIGWINCH are ignored during the replay, frames are only
+ * rendered where the recording has them, recorded terminal replies are not
+ * acted on, and kiloc_run returns when the replay ends.
+ *
+ * @param path The recording file.
+ * @param realtime True to keep the recorded timing.
+ * @return 0 on success, -1 on error.
+ */
+int kiloc_replay(const char *path, bool realtime);
+
+/**
+ * @brief Returns the terminal capabilities the encoder currently uses.
+ *
+ * On a terminal, kiloc_init sends DA1, DA2, DECRQM 2026 and XTGETTCAP queries
+ * without waiting. Replies are picked up by the input parser while kiloc_run
+ * runs; outside kiloc_run, kiloc_render reads the ones already there. Queries
+ * still unanswered after 200 ms count as unsupported, and frames rendered
+ * before then use the TERM/COLORTERM hints. Keys typed while kiloc_render
+ * reads replies are held and delivered, in order, once kiloc_run starts or
+ * the application calls kiloc_input_feed. A typed ESC P is still Alt+P.
+ * A completed probe is cached per terminal under $XDG_CACHE_HOME/kiloc
+ * (or ~/.cache/kiloc) and reused by later runs, which then skip the probe.
+ *
+ * @param out Receives the capabilities.
+ */
+void kiloc_caps(struct kiloc_caps *out);
+
+/**
+ * @brief Overrides the detected capabilities and stops the probe.
+ * @param caps The capabilities to use (kitty_keys and probed are ignored).
+ */
+void kiloc_set_caps(const struct kiloc_caps *caps);
+
 
 /* Global config */
 